@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "anytime.h"
+
+
+typedef struct
+{
+    int *order;
+    char *reversed;
+    int capacity;
+} AnytimeScratch;                               // The background thread's working copy of an order
+
+static int GrowScratch (AnytimeScratch *scratch, int count)
+{
+    if (count > scratch->capacity)
+    {
+        int *newOrder = realloc(scratch->order, (size_t)count * sizeof(int));
+        char *newReversed = newOrder ? realloc(scratch->reversed, (size_t)count) : NULL;
+
+        if (newOrder) scratch->order = newOrder;
+        if (!newReversed)
+        {
+            return (-1);
+        }
+        scratch->reversed = newReversed;
+        scratch->capacity = count;
+    }
+    return (0);
+}
+
+// First visit: pull the strokes out of the job and find a nearest neighbour order for them.
+// The line only becomes visible to the sender once everything it needs is in place.
+static void FirstOrder (AnytimeOrder *anytime, AnytimeLine *line, AnytimeScratch *scratch)
+{
+    StrokeList list = {0};
+    int *order = NULL;
+    char *reversed = NULL;
+    double layoutTravel, travel, started;
+    int converged, k;
+
+    if (ExtractStrokes(&anytime->motion->records[line->start], line->end - line->start, line->penX, line->penY, &list) != 0
+        || list.count == 0
+        || GrowScratch(scratch, list.count) != 0
+        || !(order = malloc((size_t)list.count * sizeof(int)))
+        || !(reversed = malloc((size_t)list.count)))
+    {
+        // Nothing to order, or no memory to do it with: the line keeps its layout order
+        FreeStrokeList(&list);
+        free(order);
+        line->converged = 1;
+        return;
+    }
+
+    layoutTravel = StrokeTravel(list.strokes, list.count, line->penX, line->penY, NULL, NULL);
+    started = WallClockMs();
+    travel = OrderStrokes(list.strokes, list.count, line->penX, line->penY, scratch->order, scratch->reversed, ANYTIME_SLICE_MS);
+    converged = WallClockMs() - started < ANYTIME_SLICE_MS;     // 2-opt ran out of moves before it ran out of time
+
+    if (travel < layoutTravel)
+    {
+        memcpy(order, scratch->order, (size_t)list.count * sizeof(int));
+        memcpy(reversed, scratch->reversed, (size_t)list.count);
+    }
+    else
+    {
+        for (k = 0; k < list.count; k++)
+        {
+            order[k] = k;
+            reversed[k] = 0;
+        }
+        travel = layoutTravel;
+    }
+
+    LockMutex(&anytime->mutex);
+    if (!line->taken)
+    {
+        line->strokes = list.strokes;
+        line->count = list.count;
+        line->order = order;
+        line->reversed = reversed;
+        line->layoutTravel = layoutTravel;
+        line->travel = travel;
+        line->improved = travel < layoutTravel;
+        line->ready = 1;
+        list.strokes = NULL;    // The line owns them now
+        order = NULL;
+        reversed = NULL;
+    }
+    line->converged = converged || line->taken;
+    UnlockMutex(&anytime->mutex);
+
+    FreeStrokeList(&list);
+    free(order);
+    free(reversed);
+}
+
+// Later visits: carry on with 2-opt from the best order so far and publish it if it got shorter
+static void RefineOrder (AnytimeOrder *anytime, AnytimeLine *line, AnytimeScratch *scratch)
+{
+    double travel, started;
+    int converged;
+
+    // Once a line is ready only this thread writes its order, so reading it without the lock is safe
+    memcpy(scratch->order, line->order, (size_t)line->count * sizeof(int));
+    memcpy(scratch->reversed, line->reversed, (size_t)line->count);
+
+    started = WallClockMs();
+    travel = RefineStrokeOrder(line->strokes, line->count, line->penX, line->penY, scratch->order, scratch->reversed, ANYTIME_SLICE_MS);
+    converged = WallClockMs() - started < ANYTIME_SLICE_MS;
+
+    LockMutex(&anytime->mutex);
+    if (!line->taken && travel < line->travel - 0.5)
+    {
+        memcpy(line->order, scratch->order, (size_t)line->count * sizeof(int));
+        memcpy(line->reversed, scratch->reversed, (size_t)line->count);
+        line->travel = travel;
+        line->improved = 1;
+    }
+    line->converged = converged || line->taken;
+    UnlockMutex(&anytime->mutex);
+}
+
+// Background thread: always works on the earliest line that is neither sent nor finished,
+// a slice at a time, so whatever the sender dequeues next has had the most attention.
+static void AnytimeWorker (void *argument)
+{
+    AnytimeOrder *anytime = argument;
+    AnytimeScratch scratch = {0};
+
+    for (;;)
+    {
+        AnytimeLine *line = NULL;
+        int k;
+
+        LockMutex(&anytime->mutex);
+        if (!anytime->stop)
+        {
+            for (k = anytime->nextLine; k < anytime->lineCount; k++)
+            {
+                if (!anytime->lines[k].converged)
+                {
+                    line = &anytime->lines[k];
+                    break;
+                }
+            }
+        }
+        UnlockMutex(&anytime->mutex);
+
+        if (!line)
+        {
+            break;      // Stopped, or every line still waiting is as good as 2-opt can make it
+        }
+
+        if (!line->ready)
+        {
+            FirstOrder(anytime, line, &scratch);
+        }
+        else
+        {
+            RefineOrder(anytime, line, &scratch);
+        }
+    }
+
+    free(scratch.order);
+    free(scratch.reversed);
+}
+
+
+int StartAnytime (AnytimeOrder *anytime, const MotionBuffer *motion)
+{
+    int32_t penX = 0, penY = 0;     // The job starts at the origin
+    size_t i;
+    int line;
+
+    memset(anytime, 0, sizeof(*anytime));
+    anytime->motion = motion;
+
+    // Each marker starts a line; anything before the first marker is a line of its own
+    for (i = 0; i < motion->count; i++)
+    {
+        if (motion->records[i].op == MOTION_LINE || i == 0)
+        {
+            anytime->lineCount++;
+        }
+    }
+    if (anytime->lineCount > 0)
+    {
+        anytime->lines = calloc((size_t)anytime->lineCount, sizeof(AnytimeLine));
+        if (!anytime->lines)
+        {
+            printf("Error: Unable to allocate memory for stroke ordering.\n");
+            return (-1);
+        }
+    }
+
+    line = -1;
+    for (i = 0; i < motion->count; i++)
+    {
+        const MotionRecord *record = &motion->records[i];
+
+        if (record->op == MOTION_LINE || i == 0)
+        {
+            if (line >= 0)
+            {
+                anytime->lines[line].end = i;
+            }
+            line++;
+            anytime->lines[line].start = i;
+            anytime->lines[line].penX = penX;
+            anytime->lines[line].penY = penY;
+        }
+        if (IsMove(record->op))
+        {
+            penX = record->x;
+            penY = record->y;
+        }
+    }
+    if (line >= 0)
+    {
+        anytime->lines[line].end = motion->count;
+    }
+
+    InitMutex(&anytime->mutex);
+    anytime->running = StartThread(&anytime->thread, AnytimeWorker, anytime) == 0;
+    if (!anytime->running)
+    {
+        printf("Warning: Unable to start the stroke ordering thread, each line is ordered as it is sent.\n");
+    }
+
+    return (0);
+}
+
+
+// A line the background thread never got to is dequeued with a plain nearest neighbour order, which for one
+// line of text costs far less than a single round trip to the robot
+static void GreedyOrder (AnytimeOrder *anytime, AnytimeLine *line)
+{
+    StrokeList list = {0};
+    int *order = NULL;
+    char *reversed = NULL;
+    double layoutTravel, travel;
+
+    if (ExtractStrokes(&anytime->motion->records[line->start], line->end - line->start, line->penX, line->penY, &list) != 0
+        || list.count == 0
+        || !(order = malloc((size_t)list.count * sizeof(int)))
+        || !(reversed = malloc((size_t)list.count)))
+    {
+        FreeStrokeList(&list);
+        free(order);
+        return;
+    }
+
+    layoutTravel = StrokeTravel(list.strokes, list.count, line->penX, line->penY, NULL, NULL);
+    travel = OrderStrokes(list.strokes, list.count, line->penX, line->penY, order, reversed, 0.0);     // No time for 2-opt
+
+    line->strokes = list.strokes;
+    line->count = list.count;
+    line->order = order;
+    line->reversed = reversed;
+    line->layoutTravel = layoutTravel;
+    line->travel = travel;
+    line->improved = travel < layoutTravel;
+    line->greedy = 1;
+}
+
+
+const MotionRecord *TakeAnytimeLine (AnytimeOrder *anytime, int index, MotionBuffer *scratch, size_t *count)
+{
+    AnytimeLine *line = &anytime->lines[index];
+    const MotionRecord *records = anytime->motion->records;
+    int ready, k;
+
+    LockMutex(&anytime->mutex);
+    line->taken = 1;        // From here on the background thread leaves this line alone
+    if (anytime->nextLine <= index)
+    {
+        anytime->nextLine = index + 1;
+    }
+    ready = line->ready;
+    UnlockMutex(&anytime->mutex);
+
+    if (!ready)
+    {
+        GreedyOrder(anytime, line);
+    }
+
+    *count = line->end - line->start;
+    if (!line->improved)
+    {
+        return &records[line->start];
+    }
+
+    ClearMotion(scratch);
+    if (records[line->start].op == MOTION_LINE && AppendMotionRecord(scratch, &records[line->start]) != 0)
+    {
+        line->improved = 0;
+        return &records[line->start];
+    }
+    for (k = 0; k < line->count; k++)
+    {
+        // Strokes are relative to this line, so offset them back into the whole job
+        Stroke stroke = line->strokes[line->order[k]];
+
+        stroke.first += line->start;
+        if (AppendStroke(scratch, records, &stroke, line->reversed[k]) != 0)
+        {
+            line->improved = 0;     // Out of memory: the layout order is still there to fall back on
+            return &records[line->start];
+        }
+    }
+
+    *count = scratch->count;
+    return scratch->records;
+}
+
+
+void StopAnytime (AnytimeOrder *anytime)
+{
+    double before = 0.0, after = 0.0;
+    int reached = 0, greedy = 0, improved = 0;
+    int k;
+
+    LockMutex(&anytime->mutex);
+    anytime->stop = 1;
+    UnlockMutex(&anytime->mutex);
+    if (anytime->running)
+    {
+        JoinThread(anytime->thread);
+    }
+    DestroyMutex(&anytime->mutex);
+
+    for (k = 0; k < anytime->lineCount; k++)
+    {
+        AnytimeLine *line = &anytime->lines[k];
+
+        if (line->ready || line->greedy)
+        {
+            reached += line->ready;
+            greedy += line->greedy;
+            before += line->layoutTravel;
+            after += line->improved ? line->travel : line->layoutTravel;
+            improved += line->improved;
+        }
+        free(line->strokes);
+        free(line->order);
+        free(line->reversed);
+    }
+
+    printf("Anytime ordering: %d of %d lines refined in the background, %d ordered greedily when sent, %d improved, "
+           "travel %.1f -> %.1f mm, about %.1f s saved\n",
+           reached, anytime->lineCount, greedy, improved, before / MOTION_UNITS_PER_MM, after / MOTION_UNITS_PER_MM,
+           (before - after) / MOTION_UNITS_PER_MM / (REORDER_TRAVEL_FEED / 60.0));
+
+    free(anytime->lines);
+    anytime->lines = NULL;
+    anytime->lineCount = 0;
+}
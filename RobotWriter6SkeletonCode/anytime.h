@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+#include "motion.h"
+#include "reorder.h"
+#include "thread.h"
+
+
+#ifndef ANYTIME_H_INCLUDED
+#define ANYTIME_H_INCLUDED
+
+
+#define ANYTIME_SLICE_MS        5.0             /* Longest the background thread works on one line before checking in again */
+
+typedef struct
+{
+    size_t start, end;                          // Records of the line in the laid-out job, marker first
+    int32_t penX, penY;                         // Where the pen is when the line starts, in layout order
+    Stroke *strokes;                            // Strokes of the line, owned by the background thread until ready
+    int count;                                  // Number of strokes
+    int *order;                                 // Best order found so far
+    char *reversed;                             // Direction of each stroke in that order
+    double layoutTravel;                        // Pen up travel in layout order, micrometres
+    double travel;                              // Pen up travel in the best order, micrometres
+    int ready;                                  // Set once order holds something the sender may use
+    int improved;                               // Set once order is better than the layout
+    int converged;                              // Set once 2-opt stops finding anything
+    int greedy;                                 // Set if the sender had to order the line itself when it dequeued it
+    int taken;                                  // Set once the sender has dequeued the line
+} AnytimeLine;
+
+typedef struct
+{
+    const MotionBuffer *motion;                 // The laid-out job, read by both threads and never modified
+    AnytimeLine *lines;
+    int lineCount;
+    int nextLine;                               // First line the sender has not dequeued yet
+    int stop;                                   // Tells the background thread to finish
+    int running;                                // Whether the background thread started
+    ThreadMutex mutex;                          // Guards nextLine, stop and every line's ready, taken and order
+    ThreadHandle thread;
+} AnytimeOrder;
+
+// Splits the job into lines and starts a background thread that orders them, the next line to be sent first.
+// Nothing is ordered up front, so the first line can be sent straight away. Returns -1 if out of memory.
+int StartAnytime (AnytimeOrder *anytime, const MotionBuffer *motion);
+
+// Dequeues a line for sending: whatever order the background thread has published by now is final for it.
+// A line the thread has not reached yet gets a quick nearest neighbour order instead.
+// Returns the line's records, either rebuilt into scratch or pointing into the job when the layout order stands.
+const MotionRecord *TakeAnytimeLine (AnytimeOrder *anytime, int line, MotionBuffer *scratch, size_t *count);
+
+// Stops the background thread, prints how much travel it saved and frees everything.
+void StopAnytime (AnytimeOrder *anytime);
+
+#endif // ANYTIME_H_INCLUDED
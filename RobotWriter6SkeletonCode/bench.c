@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "motion.h"
+#include "encoder.h"
+#include "planner.h"
+#include "gcodefile.h"
+#include "jobfile.h"
+#include "link.h"
+#include "numbered.h"
+#include "simlink.h"
+#include "stream.h"
+#include "bounds.h"
+#include "thread.h"
+
+
+// Something shaped like handwriting: short strokes drawn along lines of text, with pen changes and the odd arc
+static int BuildSyntheticDocument (MotionBuffer *motion, size_t count)
+{
+    int32_t x = 0, y = 0;
+    unsigned int seed = 12345;
+
+    while (motion->count < count)
+    {
+        int strokeLength = 3 + (int)(seed % 6);
+        int k;
+
+        seed = seed * 1103515245u + 12345u;
+        x += 500 + (int32_t)(seed >> 16) % 3000;
+        if (x > 200000)
+        {
+            x = 0;
+            y -= 10000;
+        }
+
+        if (AppendMotion(motion, MOTION_TRAVEL, x, y) != 0 || AppendMotion(motion, MOTION_PEN_DOWN, x, y) != 0)
+        {
+            return (-1);
+        }
+        for (k = 0; k < strokeLength; k++)
+        {
+            MotionRecord record;
+
+            seed = seed * 1103515245u + 12345u;
+            record.x = x + (int32_t)(seed >> 16) % 2001 - 1000;
+            seed = seed * 1103515245u + 12345u;
+            record.y = y + (int32_t)(seed >> 16) % 5001;
+            record.i = (int16_t)((int32_t)(seed >> 20) % 801 - 400);
+            record.j = (int16_t)((int32_t)(seed >> 8) % 801 - 400);
+            record.op = (seed & 7) == 0 ? MOTION_ARC_CW : MOTION_DRAW;
+            if (AppendMotionRecord(motion, &record) != 0)
+            {
+                return (-1);
+            }
+        }
+        if (AppendMotion(motion, MOTION_PEN_UP, x, y) != 0)
+        {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+// The encoder as it was before FormatFixed, kept here as the reference
+static int EncodeWithPrintf (const MotionRecord *record, char *buffer)
+{
+    switch (record->op)
+    {
+        case MOTION_TRAVEL:
+            return sprintf(buffer, "G0 X%.2f Y%.2f\n", MotionToMM(record->x), MotionToMM(record->y));
+
+        case MOTION_DRAW:
+            return sprintf(buffer, "G1 X%.2f Y%.2f\n", MotionToMM(record->x), MotionToMM(record->y));
+
+        case MOTION_ARC_CW:
+        case MOTION_ARC_CCW:
+            return sprintf(buffer, "G%d X%.2f Y%.2f I%.2f J%.2f\n", record->op == MOTION_ARC_CW ? 2 : 3,
+                           MotionToMM(record->x), MotionToMM(record->y), MotionToMM(record->i), MotionToMM(record->j));
+
+        case MOTION_PEN_UP:
+            return sprintf(buffer, "S0\n");
+
+        case MOTION_PEN_DOWN:
+            return sprintf(buffer, "S1000\n");
+
+        default:
+            buffer[0] = '\0';
+            return (0);
+    }
+}
+
+
+void RunEncoderBenchmark (void)
+{
+    MotionBuffer motion = {0};
+    char reference[ENCODER_MAX_LINE], fast[ENCODER_MAX_LINE];
+    double started, printfMs, fixedMs;
+    long bytes = 0, checksum = 0, mismatches = 0;
+    size_t k;
+
+    if (BuildSyntheticDocument(&motion, BENCH_RECORDS) != 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        FreeMotion(&motion);
+        return;
+    }
+
+    for (k = 0; k < motion.count; k++)
+    {
+        EncodeWithPrintf(&motion.records[k], reference);
+        EncodeMotionRecord(&motion.records[k], fast);
+        mismatches += strcmp(reference, fast) != 0;
+    }
+
+    // The checksums stop the compiler dropping work whose result is never used
+    started = WallClockMs();
+    for (k = 0; k < motion.count; k++)
+    {
+        int length = EncodeWithPrintf(&motion.records[k], reference);
+
+        bytes += length;
+        checksum += reference[length - 2];
+    }
+    printfMs = WallClockMs() - started;
+
+    started = WallClockMs();
+    for (k = 0; k < motion.count; k++)
+    {
+        int length = EncodeMotionRecord(&motion.records[k], fast);
+
+        checksum -= fast[length - 2];
+    }
+    fixedMs = WallClockMs() - started;
+
+    printf("Encoder benchmark: %lu lines, %.1f MB, %ld lines differ (checksum %ld)\n",
+           (unsigned long)motion.count, bytes / 1e6, mismatches, checksum);
+    printf("  printf:      %7.1f ms, %6.2f M lines/s, %6.1f MB/s\n", printfMs, motion.count / printfMs / 1e3, bytes / printfMs / 1e3);
+    printf("  fixed-point: %7.1f ms, %6.2f M lines/s, %6.1f MB/s\n", fixedMs, motion.count / fixedMs / 1e3, bytes / fixedMs / 1e3);
+
+    FreeMotion(&motion);
+}
+
+
+void RunPlannerBenchmark (void)
+{
+    MotionBuffer motion = {0};
+    PlannerSettings settings;
+    JobEstimate estimate;
+    double started, plannerMs;
+
+    if (BuildSyntheticDocument(&motion, BENCH_RECORDS) != 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        FreeMotion(&motion);
+        return;
+    }
+
+    DefaultPlannerSettings(&settings);
+    started = WallClockMs();
+    if (EstimateJob(&motion, &settings, &estimate) == 0)
+    {
+        plannerMs = WallClockMs() - started;
+        printf("Planner benchmark: %ld moves and %ld pen changes in %.1f ms, %.2f M moves/s\n",
+               estimate.moves, estimate.penChanges, plannerMs, estimate.moves / plannerMs / 1e3);
+        printf("  estimated %.1f s over %d pages\n", estimate.ink + estimate.travel + estimate.pen, estimate.pageCount);
+    }
+    FreeJobEstimate(&estimate);
+    FreeMotion(&motion);
+}
+
+
+void RunBoundsBenchmark (void)
+{
+    MotionBuffer motion = {0};
+    SoftLimits limits;
+    JobBounds bounds;
+    double started, boundsMs;
+
+    if (BuildSyntheticDocument(&motion, BENCH_RECORDS) != 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        FreeMotion(&motion);
+        return;
+    }
+
+    DefaultSoftLimits(&limits);
+    started = WallClockMs();
+    MeasureJob(&motion, &bounds);
+    boundsMs = WallClockMs() - started;
+    printf("Bounds benchmark: %ld moves (%ld arcs) in %.1f ms, %.1f M moves/s, %s the soft limits\n",
+           bounds.moves, bounds.arcs, boundsMs, bounds.moves / boundsMs / 1e3, JobFitsLimits(&bounds, &limits) ? "inside" : "outside");
+    FreeMotion(&motion);
+}
+
+void RunExportBenchmark (void)
+{
+    MotionBuffer motion = {0};
+    GCodeWriter writer;
+    char line[ENCODER_MAX_LINE];
+    size_t k;
+
+    if (BuildSyntheticDocument(&motion, BENCH_RECORDS) != 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        FreeMotion(&motion);
+        return;
+    }
+
+    printf("Export benchmark: ");
+    if (OpenGCodeWriter(&writer, BENCH_EXPORT_PATH) == 0)
+    {
+        for (k = 0; k < motion.count; k++)
+        {
+            int length = EncodeMotionRecord(&motion.records[k], line);
+
+            WriteGCode(&writer, line, (size_t)length);
+        }
+        CloseGCodeWriter(&writer);
+        remove(BENCH_EXPORT_PATH);
+    }
+
+    FreeMotion(&motion);
+}
+
+
+void RunJobFileBenchmark (void)
+{
+    MotionBuffer motion = {0};
+    GCodeWriter gcodeWriter;
+    JobWriter jobWriter;
+    GCodeReader gcodeReader;
+    JobReader *jobReader = malloc(sizeof(JobReader));
+    char line[GCODE_MAX_LINE], other[GCODE_MAX_LINE];
+    double started, gcodeMs, jobMs, seekMs;
+    long lines = 0, mismatches = 0, checksum = 0;
+    long long gcodeBytes, jobBytes;
+    size_t k;
+    int length;
+
+    if (!jobReader || BuildSyntheticDocument(&motion, BENCH_RECORDS) != 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        FreeMotion(&motion);
+        free(jobReader);
+        return;
+    }
+
+    printf("Job file benchmark: ");
+    if (OpenGCodeWriter(&gcodeWriter, BENCH_EXPORT_PATH) != 0)
+    {
+        FreeMotion(&motion);
+        free(jobReader);
+        return;
+    }
+    if (OpenJobWriter(&jobWriter, BENCH_JOB_PATH, 0, ENCODER_DECIMALS) != 0)
+    {
+        CloseGCodeWriter(&gcodeWriter);
+        remove(BENCH_EXPORT_PATH);
+        FreeMotion(&motion);
+        free(jobReader);
+        return;
+    }
+    for (k = 0; k < motion.count; k++)
+    {
+        length = EncodeMotionRecord(&motion.records[k], line);
+        WriteGCode(&gcodeWriter, line, (size_t)length);
+        WriteJobCommand(&jobWriter, line, (size_t)length);
+    }
+    gcodeBytes = gcodeWriter.bytes;
+    jobBytes = jobWriter.bytes;
+    CloseGCodeWriter(&gcodeWriter);
+    printf("  ");
+    CloseJobWriter(&jobWriter);
+    FreeMotion(&motion);
+
+    // Both files are now in the disk cache, so this times decoding rather than the disk
+    started = WallClockMs();
+    if (OpenGCodeReader(&gcodeReader, BENCH_EXPORT_PATH) == 0)
+    {
+        while ((length = ReadGCodeLine(&gcodeReader, line)) > 0)
+        {
+            checksum += line[length - 2];
+            lines++;
+        }
+        CloseGCodeReader(&gcodeReader);
+    }
+    gcodeMs = WallClockMs() - started;
+
+    started = WallClockMs();
+    if (OpenJobReader(jobReader, BENCH_JOB_PATH) == 0)
+    {
+        while ((length = ReadJobLine(jobReader, line)) > 0)
+        {
+            checksum -= line[length - 2];
+        }
+        CloseJobReader(jobReader);
+    }
+    jobMs = WallClockMs() - started;
+
+    // Resuming at the last command: the G-code has to be read up to it, the job file jumps to the nearest checkpoint
+    started = WallClockMs();
+    if (OpenJobReader(jobReader, BENCH_JOB_PATH) == 0)
+    {
+        mismatches += SeekJobCommand(jobReader, lines) != 0;
+        CloseJobReader(jobReader);
+    }
+    seekMs = WallClockMs() - started;
+
+    // And once more in lockstep, to prove the job file gives back every line exactly
+    if (OpenGCodeReader(&gcodeReader, BENCH_EXPORT_PATH) == 0)
+    {
+        if (OpenJobReader(jobReader, BENCH_JOB_PATH) == 0)
+        {
+            while ((length = ReadGCodeLine(&gcodeReader, line)) > 0)
+            {
+                mismatches += ReadJobLine(jobReader, other) != length || memcmp(line, other, (size_t)length) != 0;
+            }
+            mismatches += ReadJobLine(jobReader, other) != 0;
+            CloseJobReader(jobReader);
+        }
+        CloseGCodeReader(&gcodeReader);
+    }
+    remove(BENCH_EXPORT_PATH);
+    remove(BENCH_JOB_PATH);
+    free(jobReader);
+
+    printf("  %ld lines, %ld differ (checksum %ld)\n", lines, mismatches, checksum);
+    printf("  G-code:   %6.1f MB, %7.1f ms to read back, %6.2f M lines/s\n", gcodeBytes / 1e6, gcodeMs, lines / gcodeMs / 1e3);
+    printf("  job file: %6.1f MB, %7.1f ms to read back, %6.2f M lines/s\n", jobBytes / 1e6, jobMs, lines / jobMs / 1e3);
+    printf("  resuming at the last line: %.1f ms from the G-code, %.2f ms from the job file\n", gcodeMs, seekMs);
+}
+
+
+// Send-and-wait with nothing to catch damage: a line that never gets its ok is simply given up on
+static void SendPlain (SerialLink link, const char *text, size_t length)
+{
+    char reply[LINK_MAX_REPLY];
+    int got;
+
+    link.send(link.context, text, length);
+    while ((got = link.receive(link.context, reply, sizeof(reply), NUMBERED_TIMEOUT_MS)) > 0 && strncmp(reply, "ok", 2) != 0)
+    {
+    }
+}
+
+// The start of the synthetic document as encoded lines for the link benchmarks, every coordinate divided by scale
+static size_t EncodeLinkLines (char *lines, int *lengths, int32_t scale)
+{
+    MotionBuffer motion = {0};
+    size_t count = 0, k;
+
+    if (BuildSyntheticDocument(&motion, BENCH_LINK_LINES) != 0)
+    {
+        FreeMotion(&motion);
+        return (0);
+    }
+    for (k = 0; k < motion.count && count < BENCH_LINK_LINES; k++)
+    {
+        MotionRecord record = motion.records[k];
+
+        record.x /= scale;
+        record.y /= scale;
+        record.i = (int16_t)(record.i / scale);
+        record.j = (int16_t)(record.j / scale);
+        lengths[count] = EncodeMotionRecord(&record, &lines[count * ENCODER_MAX_LINE]);
+        count += lengths[count] > 0;
+    }
+    FreeMotion(&motion);
+    return (count);
+}
+
+void RunLinkBenchmark (void)
+{
+    static const double errorRates[] = { 0.0, 1e-6, 1e-5, 1e-4 };
+    char *lines;
+    int *lengths;
+    size_t count = 0, k;
+    int rate;
+
+    lines = malloc((size_t)BENCH_LINK_LINES * ENCODER_MAX_LINE);
+    lengths = malloc((size_t)BENCH_LINK_LINES * sizeof(int));
+    if (!lines || !lengths || (count = EncodeLinkLines(lines, lengths, 1)) == 0)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        free(lines);
+        free(lengths);
+        return;
+    }
+
+    printf("Link benchmark: %lu lines at %.0f baud, send and wait\n", (unsigned long)count, BENCH_LINK_BAUD);
+    for (rate = 0; rate < (int)(sizeof(errorRates) / sizeof(errorRates[0])); rate++)
+    {
+        SimulatedController plain, checked;
+        NumberedSender sender;
+
+        StartSimulatedController(&plain, BENCH_LINK_BAUD, errorRates[rate], 1);
+        for (k = 0; k < count; k++)
+        {
+            SendPlain(SimulatedLink(&plain), &lines[k * ENCODER_MAX_LINE], (size_t)lengths[k]);
+        }
+
+        StartSimulatedController(&checked, BENCH_LINK_BAUD, errorRates[rate], 1);
+        if (StartNumbered(&sender, SimulatedLink(&checked)) == 0)
+        {
+            for (k = 0; k < count && SendNumbered(&sender, &lines[k * ENCODER_MAX_LINE], (size_t)lengths[k]) == 0; k++)
+            {
+            }
+        }
+
+        printf("  bit error rate %-6g plain:    %7.0f lines/s, %4ld damaged lines acted on\n",
+               errorRates[rate], plain.accepted / SimulatedSeconds(&plain), plain.damagedAccepted);
+        printf("  %21s numbered: %7.0f lines/s, %4ld damaged lines acted on, %ld resent, %ld timeouts%s\n", "",
+               (checked.accepted - 1) / SimulatedSeconds(&checked), checked.damagedAccepted, sender.resent, sender.timeouts,
+               sender.failed ? ", gave up" : "");
+    }
+
+    free(lines);
+    free(lengths);
+}
+
+void RunStreamBenchmark (void)
+{
+    static const double latencies[] = { 1.0, 16.0 };   // ms each way: a quick adapter, and an FTDI chip's default latency timer
+    char *lines;
+    int *lengths;
+    size_t count = 0, k;
+    int modelMotion, latency;
+
+    lines = malloc((size_t)BENCH_LINK_LINES * ENCODER_MAX_LINE);
+    lengths = malloc((size_t)BENCH_LINK_LINES * sizeof(int));
+    if (!lines || !lengths)
+    {
+        printf("Error: Unable to allocate memory for the benchmark.\n");
+        free(lines);
+        free(lengths);
+        return;
+    }
+
+    printf("Stream benchmark: %d lines at %.0f baud into GRBL's %d byte receive buffer\n", BENCH_LINK_LINES, BENCH_STREAM_BAUD, STREAM_RX_BUFFER);
+    for (modelMotion = 0; modelMotion <= 1; modelMotion++)
+    {
+        count = EncodeLinkLines(lines, lengths, modelMotion ? BENCH_STREAM_SCALE : 1);
+        for (latency = 0; latency < (int)(sizeof(latencies) / sizeof(latencies[0])); latency++)
+        {
+            SimulatedController waited, streamed;
+            StreamSender sender;
+
+            StartSimulatedController(&waited, BENCH_STREAM_BAUD, 0.0, 1);
+            SimulateGrbl(&waited, STREAM_RX_BUFFER, latencies[latency], modelMotion);
+            for (k = 0; k < count; k++)
+            {
+                SendPlain(SimulatedLink(&waited), &lines[k * ENCODER_MAX_LINE], (size_t)lengths[k]);
+            }
+
+            StartSimulatedController(&streamed, BENCH_STREAM_BAUD, 0.0, 1);
+            SimulateGrbl(&streamed, STREAM_RX_BUFFER, latencies[latency], modelMotion);
+            StartStreaming(&sender, SimulatedLink(&streamed), STREAM_RX_BUFFER);
+            for (k = 0; k < count && SendStreamed(&sender, &lines[k * ENCODER_MAX_LINE], (size_t)lengths[k]) == 0; k++)
+            {
+            }
+            FinishStreaming(&sender);
+
+            if (!modelMotion)
+            {
+                printf("  link alone, %2.0f ms latency:  send and wait %6.0f lines/s, streaming %6.0f lines/s (%.1fx), %ld bytes lost\n",
+                       latencies[latency], waited.accepted / SimulatedSeconds(&waited), streamed.accepted / SimulatedSeconds(&streamed),
+                       SimulatedSeconds(&waited) / SimulatedSeconds(&streamed), streamed.overflows);
+            }
+            else
+            {
+                printf("  drawing at 1/%d size, %2.0f ms latency:  send and wait %6.1f s with %5ld stops mid-stroke, "
+                       "streaming %6.1f s with %5ld, %.1f s of moves\n",
+                       BENCH_STREAM_SCALE, latencies[latency], SimulatedJobSeconds(&waited), waited.stalls,
+                       SimulatedJobSeconds(&streamed), streamed.stalls, streamed.motionUs / 1e6);
+            }
+        }
+    }
+
+    free(lines);
+    free(lengths);
+}
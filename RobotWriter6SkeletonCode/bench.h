@@ -0,0 +1,43 @@
+#include <stdio.h>
+
+
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+
+#define BENCH_RECORDS           2000000         /* Steps in the synthetic document the benchmarks run over */
+#define BENCH_EXPORT_PATH       "benchmark.gcode" /* Scratch file for the export benchmark, deleted afterwards */
+#define BENCH_LINK_LINES        20000           /* Commands sent through the simulated controller for each error rate */
+#define BENCH_LINK_BAUD         250000.0        /* Baud rate of the simulated link */
+#define BENCH_STREAM_BAUD       115200.0        /* Baud rate for the streaming benchmark, the robot's own */
+#define BENCH_STREAM_SCALE      10              /* The synthetic strokes are drawn this many times smaller, like small handwriting */
+#define BENCH_JOB_PATH          "benchmark.rwj" /* Scratch job file for the job file benchmark, deleted afterwards */
+
+// Encodes a large synthetic document with printf-style formatting and with the fixed-point encoder,
+// checks that both produce the same bytes and prints lines per second for each.
+void RunEncoderBenchmark (void);
+
+// Plans the same synthetic document with the time estimator and prints moves per second.
+void RunPlannerBenchmark (void);
+
+// Measures the synthetic document's bounding box for the pre-flight check and prints moves per second.
+void RunBoundsBenchmark (void);
+
+// Encodes the synthetic document into a .gcode file through the export writer and prints MB/s.
+void RunExportBenchmark (void);
+
+// Writes the synthetic document as both G-code and a job file, then reads each back, checks they give the same
+// lines and prints their sizes and lines per second.
+void RunJobFileBenchmark (void);
+
+// Sends the start of the synthetic document to a simulated controller that flips bits at rates from 0 to 1e-4,
+// once plainly and once with numbered, checksummed lines, and prints the lines per second that got through
+// and how many damaged lines the controller acted on.
+void RunLinkBenchmark (void);
+
+// Sends the same lines to a simulated GRBL with a STREAM_RX_BUFFER byte receive buffer, waiting for each ok and
+// then streaming, over a fast and a slow USB serial adapter. Prints lines per second over the link alone, then the
+// job time and the stops mid-stroke when the moves take time and the planner can run dry.
+void RunStreamBenchmark (void);
+
+#endif // BENCH_H_INCLUDED
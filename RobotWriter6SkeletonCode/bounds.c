@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bounds.h"
+#include "encoder.h"
+
+
+#define FULL_TURN               6.283185307179586
+
+
+void DefaultSoftLimits (SoftLimits *limits)
+{
+    limits->minX = BOUNDS_MIN_X_MM;
+    limits->maxX = BOUNDS_MAX_X_MM;
+    limits->minY = BOUNDS_MIN_Y_MM;
+    limits->maxY = BOUNDS_MAX_Y_MM;
+    limits->minFitScale = BOUNDS_MIN_FIT_SCALE;
+}
+
+
+static void AddPoint (JobBounds *bounds, int32_t x, int32_t y)
+{
+    if (x < bounds->minX) bounds->minX = x;
+    if (x > bounds->maxX) bounds->maxX = x;
+    if (y < bounds->minY) bounds->minY = y;
+    if (y > bounds->maxY) bounds->maxY = y;
+}
+
+// The ends are added as moves; this adds the points where the arc is furthest left, right, up or down,
+// for each of those directions the arc sweeps through on its way from start to end
+static void AddArcExtremes (JobBounds *bounds, int32_t startX, int32_t startY, const MotionRecord *arc)
+{
+    double centreX = (double)startX + arc->i;
+    double centreY = (double)startY + arc->j;
+    double radius = sqrt((double)arc->i * arc->i + (double)arc->j * arc->j);
+    double from = atan2(startY - centreY, startX - centreX);
+    double to = atan2(arc->y - centreY, arc->x - centreX);
+    double sweep;
+    int quarter;
+
+    if (arc->op == MOTION_ARC_CW)
+    {
+        // A clockwise arc covers the same points as the anticlockwise one from its end back to its start
+        double swap = from;
+        from = to;
+        to = swap;
+    }
+    sweep = to - from;
+    if (sweep <= 0.0)
+    {
+        sweep += FULL_TURN;     // Equal ends are a full circle, as the controller reads them
+    }
+
+    for (quarter = 0; quarter < 4; quarter++)
+    {
+        double angle = fmod(quarter * FULL_TURN / 4.0 - from + FULL_TURN, FULL_TURN);   // How far round from the start this extreme lies
+
+        if (angle <= sweep)
+        {
+            double x = centreX + (quarter == 0 ? radius : quarter == 2 ? -radius : 0.0);
+            double y = centreY + (quarter == 1 ? radius : quarter == 3 ? -radius : 0.0);
+
+            AddPoint(bounds, (int32_t)floor(x), (int32_t)floor(y));
+            AddPoint(bounds, (int32_t)ceil(x), (int32_t)ceil(y));
+        }
+    }
+}
+
+void MeasureJob (const MotionBuffer *motion, JobBounds *bounds)
+{
+    int32_t x = 0, y = 0;       // The preamble leaves the pen at the origin
+    size_t i;
+
+    bounds->minX = bounds->maxX = 0;
+    bounds->minY = bounds->maxY = 0;
+    bounds->moves = 0;
+    bounds->arcs = 0;
+
+    for (i = 0; i < motion->count; i++)
+    {
+        const MotionRecord *record = &motion->records[i];
+
+        if (!IsMove(record->op))
+        {
+            continue;   // Pen changes happen where the pen is, markers are never sent
+        }
+        if (IsArc(record->op))
+        {
+            AddArcExtremes(bounds, x, y, record);
+            bounds->arcs++;
+        }
+        AddPoint(bounds, record->x, record->y);
+        bounds->moves++;
+        x = record->x;
+        y = record->y;
+    }
+}
+
+
+int JobFitsLimits (const JobBounds *bounds, const SoftLimits *limits)
+{
+    return MotionToMM(bounds->minX) >= limits->minX + BOUNDS_MARGIN_MM
+        && MotionToMM(bounds->maxX) <= limits->maxX - BOUNDS_MARGIN_MM
+        && MotionToMM(bounds->minY) >= limits->minY + BOUNDS_MARGIN_MM
+        && MotionToMM(bounds->maxY) <= limits->maxY - BOUNDS_MARGIN_MM;
+}
+
+// How far a coordinate may be scaled before it reaches limit, which is on the same side of the origin
+static double ScaleToLimit (int32_t extent, double limit)
+{
+    double mm = MotionToMM(extent);
+
+    return mm != 0.0 && limit / mm < 1.0 ? limit / mm : 1.0;
+}
+
+double FitJobToLimits (MotionBuffer *motion, JobBounds *bounds, const SoftLimits *limits)
+{
+    double minX = limits->minX + BOUNDS_MARGIN_MM, maxX = limits->maxX - BOUNDS_MARGIN_MM;
+    double minY = limits->minY + BOUNDS_MARGIN_MM, maxY = limits->maxY - BOUNDS_MARGIN_MM;
+    double scale = 1.0;
+    size_t i;
+
+    if (minX > 0.0 || maxX < 0.0 || minY > 0.0 || maxY < 0.0)
+    {
+        return (0.0);   // The preamble itself would be out of bounds
+    }
+
+    // Shrinking about the origin shrinks the whole box with it, so the tightest side decides
+    scale = fmin(scale, ScaleToLimit(bounds->minX, minX));
+    scale = fmin(scale, ScaleToLimit(bounds->maxX, maxX));
+    scale = fmin(scale, ScaleToLimit(bounds->minY, minY));
+    scale = fmin(scale, ScaleToLimit(bounds->maxY, maxY));
+    scale = floor(scale * 10000.0) / 10000.0;      // Round down, so rounding to micrometres cannot overshoot
+    if (scale < limits->minFitScale)
+    {
+        return (0.0);
+    }
+
+    for (i = 0; i < motion->count; i++)
+    {
+        MotionRecord *record = &motion->records[i];
+
+        // Rounded towards zero, which is towards the origin and so always further inside the limits
+        record->x = (int32_t)(record->x * scale);
+        record->y = (int32_t)(record->y * scale);
+        if (IsArc(record->op))
+        {
+            record->i = (int16_t)lround(record->i * scale);
+            record->j = (int16_t)lround(record->j * scale);
+        }
+    }
+
+    // The ends and offsets were rounded each on their own, which can leave arcs GRBL refuses
+    if (ConformArcs(motion, ENCODER_DECIMALS) < 0)
+    {
+        return (0.0);
+    }
+
+    MeasureJob(motion, bounds);
+    return (scale);
+}
+
+
+void PrintJobBounds (const JobBounds *bounds, const SoftLimits *limits)
+{
+    printf("Job bounds: X %.2f to %.2f mm, Y %.2f to %.2f mm over %ld moves (%ld arcs); soft limits X %.1f to %.1f, Y %.1f to %.1f\n",
+           MotionToMM(bounds->minX), MotionToMM(bounds->maxX), MotionToMM(bounds->minY), MotionToMM(bounds->maxY),
+           bounds->moves, bounds->arcs, limits->minX, limits->maxX, limits->minY, limits->maxY);
+}
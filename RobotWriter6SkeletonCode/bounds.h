@@ -0,0 +1,48 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef BOUNDS_H_INCLUDED
+#define BOUNDS_H_INCLUDED
+
+
+#define BOUNDS_MIN_X_MM         (-10.0)         /* Soft limits of the work area in job coordinates: an A4 sheet with the */
+#define BOUNDS_MAX_X_MM         200.0           /* origin 10 mm in from its left edge and 12 mm down from its top */
+#define BOUNDS_MIN_Y_MM         (-285.0)
+#define BOUNDS_MAX_Y_MM         12.0
+#define BOUNDS_MARGIN_MM        0.01            /* Kept clear inside the limits, as snapping to the step grid later moves points by up to 6.75 um */
+#define BOUNDS_MIN_FIT_SCALE    0.5             /* Smallest a job may be shrunk to fit before it is refused instead */
+
+typedef struct
+{
+    double minX, maxX;                          // mm
+    double minY, maxY;                          // mm
+    double minFitScale;                         // 0 to 1; 1 never shrinks the job, it is only accepted or refused
+} SoftLimits;                                   // Where the robot may go
+
+typedef struct
+{
+    int32_t minX, minY, maxX, maxY;             // Micrometres, covering every point the pen passes, up or down
+    long moves;                                 // Moves measured
+    long arcs;                                  // Of which arcs, measured along the curve rather than by their end points
+} JobBounds;                                    // The area the job covers
+
+void DefaultSoftLimits (SoftLimits *limits);
+
+// Measures the job in one pass, starting from the origin where the preamble leaves the pen. Travel counts as
+// much as drawing, and an arc's box includes every axis extreme the curve passes through, not just its ends.
+void MeasureJob (const MotionBuffer *motion, JobBounds *bounds);
+
+// Returns 1 if the job stays inside the limits, less BOUNDS_MARGIN_MM on each side
+int JobFitsLimits (const JobBounds *bounds, const SoftLimits *limits);
+
+// Shrinks the job about the origin, in place, just enough for it to fit, and updates bounds to match.
+// The origin stays put, so the preamble's G1 X0 Y0 remains valid. Arcs are then checked again as they will be
+// printed, and any GRBL would refuse is drawn as lines. Returns the scale used, or 0 if the job cannot fit:
+// the limits leave out the origin, it would have to shrink below limits->minFitScale, or memory ran out.
+double FitJobToLimits (MotionBuffer *motion, JobBounds *bounds, const SoftLimits *limits);
+
+void PrintJobBounds (const JobBounds *bounds, const SoftLimits *limits);
+
+#endif // BOUNDS_H_INCLUDED
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "encoder.h"
+
+
+static const char DigitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const int32_t PowersOfTen[4] = { 1, 10, 100, 1000 };
+
+// Writes value (no sign) in decimal, two digits at a time from the right, and returns the end of it
+static char *WriteDigits (char *out, uint32_t value)
+{
+    int length = 1;
+    uint32_t rest;
+    char *p;
+
+    for (rest = value; rest >= 10; rest /= 10)
+    {
+        length++;
+    }
+
+    p = out + length;
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+
+        value /= 100;
+        *--p = DigitPairs[pair + 1];
+        *--p = DigitPairs[pair];
+    }
+    if (value >= 10)
+    {
+        *--p = DigitPairs[value * 2 + 1];
+        *--p = DigitPairs[value * 2];
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+
+    return out + length;
+}
+
+
+// The magnitude in units of the last printed digit
+static uint32_t RoundToDigits (uint32_t magnitude, int decimals)
+{
+    uint32_t divisor = (uint32_t)PowersOfTen[3 - decimals];    // Micrometres per last printed digit
+    uint32_t scaled = magnitude / divisor;
+    uint32_t remainder = magnitude % divisor;
+
+    // Round the way printf rounds the double MotionToMM() produces, not the exact decimal value.
+    // Only an exact half needs care: the double is then just above or just below it (or exactly on it,
+    // where printf rounds to even), and fma gives the sign of that difference without rounding it away.
+    if (remainder * 2 > divisor)
+    {
+        scaled++;
+    }
+    else if (remainder * 2 == divisor)
+    {
+        double mm = (double)magnitude / MOTION_UNITS_PER_MM;       // What MotionToMM() gives, without the sign
+        double error = fma(mm, MOTION_UNITS_PER_MM, -(double)magnitude);
+
+        if (error > 0.0 || (error == 0.0 && (scaled & 1)))
+        {
+            scaled++;
+        }
+    }
+    return scaled;
+}
+
+
+int FormatFixed (int32_t units, int decimals, char *out)
+{
+    char *start = out;
+    uint32_t magnitude = units < 0 ? 0u - (uint32_t)units : (uint32_t)units;
+    uint32_t scaled = RoundToDigits(magnitude, decimals);
+    uint32_t whole, fraction;
+
+    if (units < 0)
+    {
+        *out++ = '-';   // printf keeps the sign even when the value rounds to zero
+    }
+    whole = scaled / (uint32_t)PowersOfTen[decimals];
+    fraction = scaled % (uint32_t)PowersOfTen[decimals];
+    out = WriteDigits(out, whole);
+    if (decimals > 0)
+    {
+        *out++ = '.';
+        if (decimals == 3)
+        {
+            *out++ = (char)('0' + fraction / 100);
+            fraction %= 100;
+        }
+        if (decimals >= 2)
+        {
+            *out++ = DigitPairs[fraction * 2];
+            *out++ = DigitPairs[fraction * 2 + 1];
+        }
+        else
+        {
+            *out++ = (char)('0' + fraction);
+        }
+    }
+    *out = '\0';
+
+    return (int)(out - start);
+}
+
+
+int32_t PrintedUnits (int32_t units, int decimals)
+{
+    uint32_t magnitude = units < 0 ? 0u - (uint32_t)units : (uint32_t)units;
+    int32_t printed = (int32_t)RoundToDigits(magnitude, decimals) * PowersOfTen[3 - decimals];
+
+    return units < 0 ? -printed : printed;
+}
+
+
+int ConformArc (int32_t fromX, int32_t fromY, MotionRecord *arc, int decimals)
+{
+    int32_t unit = PowersOfTen[3 - decimals];
+    int32_t startX = PrintedUnits(fromX, decimals), startY = PrintedUnits(fromY, decimals);
+    int32_t chordX = PrintedUnits(arc->x, decimals) - startX, chordY = PrintedUnits(arc->y, decimals) - startY;
+    int32_t nearI = PrintedUnits((int32_t)lround((double)fromX + arc->i - startX), decimals);
+    int32_t nearJ = PrintedUnits((int32_t)lround((double)fromY + arc->j - startY), decimals);
+    double best = -1.0;
+    int32_t bestI = 0, bestJ = 0;
+    int stepI, stepJ;
+
+    if (chordX == 0 && chordY == 0)
+    {
+        return (0);
+    }
+
+    // Rounding the centre on its own is what leaves the radii apart, so its neighbours on the printed grid are tried too
+    for (stepI = -1; stepI <= 1; stepI++)
+    {
+        for (stepJ = -1; stepJ <= 1; stepJ++)
+        {
+            int32_t i = nearI + stepI * unit, j = nearJ + stepJ * unit;
+            double startRadius = sqrt((double)i * i + (double)j * j);
+            double endRadius = sqrt((double)(chordX - i) * (chordX - i) + (double)(chordY - j) * (chordY - j));
+            double mismatch = fabs(startRadius - endRadius);
+            double slack = fmax(ENCODER_ARC_SLACK_MM * MOTION_UNITS_PER_MM, ENCODER_ARC_SLACK_RATIO * fmin(startRadius, endRadius));
+
+            // The smaller radius, so the arc still passes when it is reversed and its end becomes its start
+            if (abs(i) <= MOTION_MAX_ARC_OFFSET && abs(j) <= MOTION_MAX_ARC_OFFSET && mismatch <= slack && (best < 0.0 || mismatch < best))
+            {
+                best = mismatch;
+                bestI = i;
+                bestJ = j;
+            }
+        }
+    }
+
+    if (best < 0.0)
+    {
+        return (0);
+    }
+    arc->i = (int16_t)bestI;
+    arc->j = (int16_t)bestJ;
+    return (1);
+}
+
+
+long ConformArcs (MotionBuffer *motion, int decimals)
+{
+    MotionBuffer lines = {0};       // Only built once an arc has to be replaced, as that needs more records
+    int32_t x = 0, y = 0;           // The preamble leaves the pen at the origin
+    long replaced = 0;
+    size_t k;
+
+    for (k = 0; k < motion->count; k++)
+    {
+        MotionRecord record = motion->records[k];
+        int failed = 0;
+
+        if (IsArc(record.op) && !ConformArc(x, y, &record, decimals))
+        {
+            if (replaced++ == 0)
+            {
+                MotionRecord *before = ExtendMotion(&lines, k);
+
+                failed = before == NULL;
+                if (before)
+                {
+                    memcpy(before, motion->records, k * sizeof(MotionRecord));
+                }
+            }
+            failed = failed || AppendArcAsLines(&lines, x, y, &record) != 0;
+        }
+        else if (replaced > 0)
+        {
+            failed = AppendMotionRecord(&lines, &record) != 0;
+        }
+        else
+        {
+            motion->records[k] = record;
+        }
+
+        if (failed)
+        {
+            FreeMotion(&lines);
+            return (-1);
+        }
+        if (IsMove(record.op))
+        {
+            x = record.x;
+            y = record.y;
+        }
+    }
+
+    if (replaced > 0)
+    {
+        FreeMotion(motion);
+        *motion = lines;
+    }
+    return (replaced);
+}
+
+
+static char *AppendFixed (char *out, const char *word, int32_t units, int decimals)
+{
+    while (*word)
+    {
+        *out++ = *word++;
+    }
+    return out + FormatFixed(units, decimals, out);
+}
+
+int EncodeMotionRecord (const MotionRecord *record, char *buffer)
+{
+    return EncodeAtPrecision(record, ENCODER_DECIMALS, buffer);
+}
+
+int EncodeAtPrecision (const MotionRecord *record, int decimals, char *buffer)
+{
+    char *out = buffer;
+
+    switch (record->op)
+    {
+        case MOTION_TRAVEL:
+        case MOTION_DRAW:
+            out = AppendFixed(out, record->op == MOTION_TRAVEL ? "G0 X" : "G1 X", record->x, decimals);
+            out = AppendFixed(out, " Y", record->y, decimals);
+            break;
+
+        case MOTION_ARC_CW:
+        case MOTION_ARC_CCW:
+            out = AppendFixed(out, record->op == MOTION_ARC_CW ? "G2 X" : "G3 X", record->x, decimals);
+            out = AppendFixed(out, " Y", record->y, decimals);
+            out = AppendFixed(out, " I", record->i, decimals);
+            out = AppendFixed(out, " J", record->j, decimals);
+            break;
+
+        case MOTION_PEN_UP:
+            memcpy(buffer, "S0\n", 4);
+            return (3);
+
+        case MOTION_PEN_DOWN:
+            memcpy(buffer, "S1000\n", 7);
+            return (6);
+
+        case MOTION_DWELL:
+            out = AppendFixed(out, "G4 P", record->i, 3);     // GRBL takes seconds, so milliseconds print like micrometres
+            break;
+
+        default:
+            buffer[0] = '\0';
+            return (0);
+    }
+
+    *out++ = '\n';
+    *out = '\0';
+    return (int)(out - buffer);
+}
+
+
+// Prints a coordinate with the same rounding as %.*f, then drops the zeros that carry no information
+static void FormatNumber (int32_t units, int decimals, char *number)
+{
+    int length = FormatFixed(units, decimals, number);
+    int start = 0;
+
+    while (decimals > 0 && number[length - 1] == '0')
+    {
+        length--;
+    }
+    if (number[length - 1] == '.')
+    {
+        length--;
+    }
+    number[length] = '\0';
+
+    if (strcmp(number, "-0") == 0)
+    {
+        strcpy(number, "0");    // Something like -0.001 rounds to -0.00
+        return;
+    }
+
+    // 0.5 and -0.5 become .5 and -.5
+    if (number[0] == '-')
+    {
+        start = 1;
+    }
+    if (number[start] == '0' && number[start + 1] == '.')
+    {
+        memmove(&number[start], &number[start + 1], (size_t)(length - start));
+    }
+}
+
+static char *AppendWord (char *out, char letter, const char *number)
+{
+    size_t length = strlen(number);
+
+    *out++ = letter;
+    memcpy(out, number, length);
+    out += length;
+    return out;
+}
+
+static char *AppendSeparator (char *out, const char *line)
+{
+    if (out != line)
+    {
+        size_t length = strlen(ENCODER_WORD_SEPARATOR);
+
+        memcpy(out, ENCODER_WORD_SEPARATOR, length);
+        out += length;
+    }
+    return out;
+}
+
+
+void StartEncoder (GCodeEncoder *encoder, int modal, int decimals)
+{
+    memset(encoder, 0, sizeof(GCodeEncoder));
+    encoder->modal = modal;
+    encoder->decimals = decimals;
+    encoder->motionMode = -1;   // Nothing is assumed about the robot until the first move has been sent
+}
+
+
+int EncodeStep (GCodeEncoder *encoder, const MotionRecord *record, char *buffer)
+{
+    char plain[ENCODER_MAX_LINE];
+    char x[ENCODER_MAX_NUMBER], y[ENCODER_MAX_NUMBER];
+    char *out = buffer;
+    int plainLength = EncodeMotionRecord(record, plain);
+    int length, mode, sendX, sendY;
+
+    encoder->plainBytes += plainLength;
+
+    if (!encoder->modal || !IsMove(record->op))
+    {
+        // Pen commands and dwells are already only sent when needed, so there is nothing to leave out
+        if (encoder->decimals == ENCODER_DECIMALS)
+        {
+            memcpy(buffer, plain, (size_t)plainLength + 1);
+            length = plainLength;
+        }
+        else
+        {
+            length = EncodeAtPrecision(record, encoder->decimals, buffer);
+        }
+        encoder->lines += length > 0;
+        encoder->bytes += length;
+        return (length);
+    }
+
+    mode = record->op == MOTION_TRAVEL ? 0 : record->op == MOTION_DRAW ? 1 : record->op == MOTION_ARC_CW ? 2 : 3;
+    FormatNumber(record->x, encoder->decimals, x);
+    FormatNumber(record->y, encoder->decimals, y);
+    sendX = strcmp(x, encoder->x) != 0;
+    sendY = strcmp(y, encoder->y) != 0;
+
+    if (!sendX && !sendY)
+    {
+        if (!IsArc(record->op))
+        {
+            buffer[0] = '\0';   // Already there, and the motion mode only matters for the next move
+            return (0);
+        }
+        sendX = 1;              // A full circle still needs an axis word
+    }
+
+    if (mode != encoder->motionMode)
+    {
+        *out++ = 'G';
+        *out++ = (char)('0' + mode);
+    }
+    if (sendX)
+    {
+        out = AppendSeparator(out, buffer);
+        out = AppendWord(out, 'X', x);
+    }
+    if (sendY)
+    {
+        out = AppendSeparator(out, buffer);
+        out = AppendWord(out, 'Y', y);
+    }
+    if (IsArc(record->op))
+    {
+        char i[ENCODER_MAX_NUMBER], j[ENCODER_MAX_NUMBER];
+
+        // Arc offsets are not modal, but a missing one counts as zero
+        FormatNumber(record->i, encoder->decimals, i);
+        FormatNumber(record->j, encoder->decimals, j);
+        if (strcmp(i, "0") != 0 || strcmp(j, "0") == 0)
+        {
+            out = AppendSeparator(out, buffer);
+            out = AppendWord(out, 'I', i);
+        }
+        if (strcmp(j, "0") != 0)
+        {
+            out = AppendSeparator(out, buffer);
+            out = AppendWord(out, 'J', j);
+        }
+    }
+    *out++ = '\n';
+    *out = '\0';
+
+    encoder->motionMode = mode;
+    strcpy(encoder->x, x);
+    strcpy(encoder->y, y);
+    encoder->lines++;
+    encoder->bytes += out - buffer;
+
+    return (int)(out - buffer);
+}
+
+
+void PrintEncoderStats (const GCodeEncoder *encoder)
+{
+    printf("Encoder sent %ld lines, %ld bytes (%ld bytes with every word written out, %.1f%% saved)\n",
+           encoder->lines, encoder->bytes, encoder->plainBytes,
+           encoder->plainBytes > 0 ? 100.0 * (encoder->plainBytes - encoder->bytes) / encoder->plainBytes : 0.0);
+}
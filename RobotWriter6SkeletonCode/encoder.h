@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef ENCODER_H_INCLUDED
+#define ENCODER_H_INCLUDED
+
+
+#define ENCODER_MAX_LINE        80              /* Longest line EncodeMotionRecord can produce, including the terminator */
+#define ENCODER_DECIMALS        2               /* Decimal places EncodeMotionRecord prints */
+#define ENCODER_MAX_NUMBER      16              /* Longest coordinate the encoder prints, including the terminator */
+#define ENCODER_WORD_SEPARATOR  " "             /* Printed between words; GRBL ignores spaces, so "" is also valid */
+#define ENCODER_ARC_SLACK_MM    0.005           /* GRBL refuses an arc (error 33) whose start and end radii differ by more than this */
+#define ENCODER_ARC_SLACK_RATIO 0.001           /* and by more than this fraction of the radius */
+
+// Writes a coordinate in mm with the given number of decimals (0 to 3) into out, NUL terminated, and returns
+// its length. The output is byte-identical to printf("%.*f", decimals, MotionToMM(units)) for every int32_t,
+// but uses integer arithmetic and a digit-pair table instead of locale-aware double formatting.
+int FormatFixed (int32_t units, int decimals, char *out);
+
+// The micrometres a coordinate stands for once FormatFixed has printed it with the given number of decimals
+int32_t PrintedUnits (int32_t units, int decimals);
+
+// Aims the centre offsets of an arc that starts at (fromX, fromY) from its start as printed, not as stored:
+// of the printable offsets around the centre, the one whose start and end radii, as printed, agree best.
+// Returns 1 with i and j updated if GRBL will accept the arc, or 0, leaving it untouched, if the radii still
+// differ by more than ENCODER_ARC_SLACK_MM and ENCODER_ARC_SLACK_RATIO, the ends print the same (GRBL would
+// draw a full circle) or the offsets no longer fit the record.
+int ConformArc (int32_t fromX, int32_t fromY, MotionRecord *arc, int decimals);
+
+// Conforms every arc of a job that starts at the origin, drawing the ones GRBL would refuse as lines instead.
+// Returns the number of arcs replaced, or -1 if out of memory.
+long ConformArcs (MotionBuffer *motion, int decimals);
+
+// Writes the G-code line for one motion record into buffer (newline terminated) and returns its length
+int EncodeMotionRecord (const MotionRecord *record, char *buffer);
+
+// The same with a chosen number of decimal places (0 to 3, as records only hold micrometres)
+int EncodeAtPrecision (const MotionRecord *record, int decimals, char *buffer);
+
+typedef struct
+{
+    int modal;                                  // 0 sends every line in full, exactly as EncodeMotionRecord writes it
+    int decimals;                               // Decimal places printed, ENCODER_DECIMALS unless the machine grid needs others
+    int motionMode;                             // Last G0/G1/G2/G3 sent, -1 before the first move
+    char x[ENCODER_MAX_NUMBER];                 // Last X sent, as printed; empty before the first move
+    char y[ENCODER_MAX_NUMBER];
+    long lines;                                 // Lines produced
+    long bytes;                                 // Bytes produced
+    long plainBytes;                            // Bytes EncodeMotionRecord would have produced for the same records
+} GCodeEncoder;                                 // What the robot already knows, so modal words need not be repeated
+
+void StartEncoder (GCodeEncoder *encoder, int modal, int decimals);
+
+// Writes the shortest line that has the same effect as the record, given what has already been sent:
+// the G word is left out when the motion mode is unchanged, X and Y when they would print the same value,
+// I and J when they are zero, and numbers lose their leading and trailing zeros (0.50 prints as .5).
+// Arcs always keep at least one axis word and one offset word, which GRBL requires.
+// Returns the length, or 0 if the record changes nothing on the robot and there is nothing to send.
+int EncodeStep (GCodeEncoder *encoder, const MotionRecord *record, char *buffer);
+
+void PrintEncoderStats (const GCodeEncoder *encoder);
+
+#endif // ENCODER_H_INCLUDED
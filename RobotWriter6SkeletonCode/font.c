@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "font.h"
+
+
+// Loads the single stroke font into memory, indexed in the order the characters appear in the file
+FontCharacter* loadFont(const char *filename, int *characterCount)
+{
+    FILE *file = fopen(filename, "r"); // Open the font file for reading
+    if (!file)
+    {
+        printf("Error: Unable to open font file %s\n", filename);
+        return NULL;
+    }
+
+    FontCharacter *fontArray = calloc(MAX_ASCII, sizeof(FontCharacter)); // One entry per supported ASCII character
+    if (!fontArray)
+    {
+        printf("Error: Unable to allocate memory for the font.\n");
+        fclose(file);
+        return NULL;
+    }
+
+    int marker, asciiCode, strokeTotal; // Header fields of each character
+    *characterCount = 0;
+
+    while (*characterCount < MAX_ASCII && fscanf(file, "%d %d %d", &marker, &asciiCode, &strokeTotal) == 3)
+    {
+        if (marker != FONT_MARKER || strokeTotal < 0) // Every character must start with the font marker
+        {
+            printf("Error: Malformed font file %s\n", filename);
+            break;
+        }
+
+        FontCharacter *character = &fontArray[*characterCount];
+        character->asciiCode = asciiCode;
+        character->strokeTotal = strokeTotal;
+        character->strokeData = malloc((size_t)(strokeTotal ? strokeTotal : 1) * sizeof(*character->strokeData));
+        if (!character->strokeData)
+        {
+            printf("Error: Unable to allocate memory for the font.\n");
+            break;
+        }
+
+        for (int k = 0; k < strokeTotal; k++) // Read the X, Y and pen state of each stroke
+        {
+            if (fscanf(file, "%d %d %d", &character->strokeData[k][0], &character->strokeData[k][1], &character->strokeData[k][2]) != 3)
+            {
+                character->strokeTotal = k;
+                break;
+            }
+        }
+        (*characterCount)++;
+    }
+
+    fclose(file);
+    return fontArray;
+}
@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+
+#ifndef FONT_H_INCLUDED
+#define FONT_H_INCLUDED
+
+
+#define MAX_ASCII               128             /* Maximum number of ASCII characters supported */
+#define FONT_MARKER             999             /* Marker used to identify font data in the input file */
+#define FONT_HEIGHT_UNITS       18.0            /* Height of a character in font units */
+
+typedef struct
+{
+    int asciiCode; //ascii code of the character
+    int strokeTotal; //Number of strokes required to draw the character
+    int (*strokeData)[3]; //Pointer to the stroke data, where each stroke has three components
+} FontCharacter; //structure to hold character data
+
+FontCharacter* loadFont(const char *filename, int *characterCount); //Function to load font data from a file into memory
+
+#endif // FONT_H_INCLUDED
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gcodefile.h"
+#include "thread.h"
+
+
+static void FlushGCodeWriter (GCodeWriter *writer)
+{
+    if (writer->used > 0 && !writer->failed && fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used)
+    {
+        printf("Error: Unable to write the G-code file.\n");
+        writer->failed = 1;
+    }
+    writer->used = 0;
+}
+
+
+int OpenGCodeWriter (GCodeWriter *writer, const char *path)
+{
+    memset(writer, 0, sizeof(GCodeWriter));
+
+    writer->buffer = malloc(GCODE_FILE_BUFFER);
+    writer->file = writer->buffer ? fopen(path, "wb") : NULL;   // Binary, so Windows does not add '\r'
+    if (!writer->file)
+    {
+        printf("Error: Unable to create %s\n", path);
+        free(writer->buffer);
+        writer->buffer = NULL;
+        return (-1);
+    }
+    setvbuf(writer->file, NULL, _IONBF, 0);     // Our buffer is already bigger than stdio's
+    writer->startedMs = WallClockMs();
+    return (0);
+}
+
+void WriteGCode (GCodeWriter *writer, const char *text, size_t length)
+{
+    if (writer->used + length > GCODE_FILE_BUFFER)
+    {
+        FlushGCodeWriter(writer);
+    }
+    memcpy(&writer->buffer[writer->used], text, length);
+    writer->used += length;
+    writer->bytes += (long long)length;
+    writer->lines++;
+}
+
+int CloseGCodeWriter (GCodeWriter *writer)
+{
+    double elapsedMs;
+
+    FlushGCodeWriter(writer);
+    if (fclose(writer->file) != 0)
+    {
+        writer->failed = 1;
+    }
+    elapsedMs = WallClockMs() - writer->startedMs;
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->file = NULL;
+
+    printf("Exported %ld lines, %.1f MB in %.1f ms (%.0f MB/s)\n", writer->lines, writer->bytes / 1e6, elapsedMs,
+           elapsedMs > 0.0 ? writer->bytes / elapsedMs / 1e3 : 0.0);
+    return writer->failed ? -1 : 0;
+}
+
+
+int OpenGCodeReader (GCodeReader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(GCodeReader));
+
+    reader->buffer = malloc(GCODE_FILE_BUFFER);
+    reader->file = reader->buffer ? fopen(path, "rb") : NULL;
+    if (!reader->file)
+    {
+        printf("Error: Unable to open %s\n", path);
+        free(reader->buffer);
+        reader->buffer = NULL;
+        return (-1);
+    }
+    return (0);
+}
+
+// Moves what is left to the front of the buffer and tops it up from the file
+static void FillGCodeReader (GCodeReader *reader)
+{
+    size_t left = reader->end - reader->start;
+
+    memmove(reader->buffer, &reader->buffer[reader->start], left);
+    reader->start = 0;
+    reader->end = left;
+    if (!reader->atEnd)
+    {
+        size_t got = fread(&reader->buffer[left], 1, GCODE_FILE_BUFFER - left, reader->file);
+
+        reader->end += got;
+        reader->atEnd = got < GCODE_FILE_BUFFER - left;
+    }
+}
+
+int ReadGCodeLine (GCodeReader *reader, char *line)
+{
+    for (;;)
+    {
+        char *text = &reader->buffer[reader->start];
+        char *newline = memchr(text, '\n', reader->end - reader->start);
+        size_t length, kept = 0, k;
+        int inComment = 0;
+
+        if (!newline && !reader->atEnd)
+        {
+            if (reader->start == 0 && reader->end == GCODE_FILE_BUFFER)
+            {
+                printf("Error: Line %ld of the G-code file is too long\n", reader->lineNumber + 1);
+                return (-1);
+            }
+            FillGCodeReader(reader);
+            continue;
+        }
+        if (!newline && reader->start == reader->end)
+        {
+            return (0);     // End of file
+        }
+
+        // The last line may have no newline of its own
+        length = newline ? (size_t)(newline - text) : reader->end - reader->start;
+        reader->start += length + (newline ? 1 : 0);
+        reader->lineNumber++;
+
+        for (k = 0; k < length && !inComment; k++)
+        {
+            if (text[k] == ';')
+            {
+                inComment = 1;
+            }
+            else if (text[k] != '\r')
+            {
+                if (kept + 2 > GCODE_MAX_LINE)
+                {
+                    printf("Error: Line %ld of the G-code file is too long\n", reader->lineNumber);
+                    return (-1);
+                }
+                line[kept++] = text[k];
+            }
+        }
+        while (kept > 0 && (line[kept - 1] == ' ' || line[kept - 1] == '\t'))
+        {
+            kept--;
+        }
+
+        if (kept == 0 || (line[0] == '(' && line[kept - 1] == ')'))
+        {
+            continue;       // Blank or a comment: nothing for the robot
+        }
+        line[kept++] = '\n';
+        line[kept] = '\0';
+        return (int)kept;
+    }
+}
+
+void CloseGCodeReader (GCodeReader *reader)
+{
+    fclose(reader->file);
+    free(reader->buffer);
+    reader->file = NULL;
+    reader->buffer = NULL;
+}
@@ -0,0 +1,43 @@
+#include <stdio.h>
+
+
+#ifndef GCODEFILE_H_INCLUDED
+#define GCODEFILE_H_INCLUDED
+
+
+#define GCODE_FILE_BUFFER       (4 * 1024 * 1024) /* Bytes gathered before each write to or read from disk */
+#define GCODE_MAX_LINE          256             /* Longest line a .gcode file may contain, including the newline */
+
+typedef struct
+{
+    FILE *file;
+    char *buffer;                               // Lines waiting to be written
+    size_t used;                                // Bytes in buffer
+    long long bytes;                            // Bytes written in total
+    long lines;                                 // Lines written in total
+    int failed;                                 // Set once a write has failed; later writes are skipped
+    double startedMs;                           // When the file was opened, for the throughput report
+} GCodeWriter;                                  // A .gcode file being exported
+
+typedef struct
+{
+    FILE *file;
+    char *buffer;                               // Bytes read from disk and not yet handed out
+    size_t start, end;                          // Unread part of buffer
+    int atEnd;                                  // Set once the file has been read to the end
+    long lineNumber;                            // Line most recently returned, counting from 1
+} GCodeReader;                                  // A .gcode file being replayed
+
+int OpenGCodeWriter (GCodeWriter *writer, const char *path);                  // Returns -1 if the file cannot be created
+void WriteGCode (GCodeWriter *writer, const char *text, size_t length);
+int CloseGCodeWriter (GCodeWriter *writer);     // Flushes, prints size and throughput; returns -1 if anything failed to write
+
+int OpenGCodeReader (GCodeReader *reader, const char *path);                  // Returns -1 if the file cannot be opened
+
+// Copies the next line into line as "...\n" with any '\r' dropped, skipping blank lines and comments
+// (';' to the end of the line, or a whole line in parentheses). Returns its length, 0 at the end of
+// the file, or -1 if a line is longer than GCODE_MAX_LINE.
+int ReadGCodeLine (GCodeReader *reader, char *line);
+void CloseGCodeReader (GCodeReader *reader);
+
+#endif // GCODEFILE_H_INCLUDED
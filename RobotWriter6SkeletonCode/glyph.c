@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "glyph.h"
+#include "encoder.h"
+
+
+double SimplifyTolerance (double textHeight)
+{
+    double tolerance = textHeight * GLYPH_HEIGHT_TOLERANCE;
+
+    return tolerance > GLYPH_MACHINE_RESOLUTION_MM ? tolerance : GLYPH_MACHINE_RESOLUTION_MM;
+}
+
+
+void StartGlyphCache (GlyphCache *cache, FontCharacter *fontArray, int characterCount, double scaleFactor)
+{
+    memset(cache, 0, sizeof(GlyphCache));
+    cache->fontArray = fontArray;
+    cache->characterCount = characterCount;
+    cache->scaleFactor = scaleFactor;
+    cache->tolerance = MotionFromMM(SimplifyTolerance(scaleFactor * FONT_HEIGHT_UNITS));
+}
+
+
+void FreeGlyphCache (GlyphCache *cache)
+{
+    int i;
+
+    for (i = 0; i < MAX_ASCII; i++)
+    {
+        free(cache->glyphs[i].records);
+    }
+    memset(cache->glyphs, 0, sizeof(cache->glyphs));
+}
+
+
+// Squared distance from p to the segment a-b, in micrometres squared
+static double SegmentDistance2 (const MotionRecord *p, const MotionRecord *a, const MotionRecord *b)
+{
+    double dx = (double)b->x - a->x;
+    double dy = (double)b->y - a->y;
+    double px = (double)p->x - a->x;
+    double py = (double)p->y - a->y;
+    double length2 = dx * dx + dy * dy;
+    double t;
+
+    if (length2 > 0.0)
+    {
+        t = (px * dx + py * dy) / length2;
+        if (t < 0.0) t = 0.0;
+        if (t > 1.0) t = 1.0;
+        px -= t * dx;
+        py -= t * dy;
+    }
+    return px * px + py * py;
+}
+
+// Marks the points between first and last that are needed to stay within tolerance
+static void MarkPolyline (const MotionRecord *points, int first, int last, double tolerance2, char *keep)
+{
+    int i, farthest = -1;
+    double farthestDistance = tolerance2;
+
+    for (i = first + 1; i < last; i++)
+    {
+        double distance = SegmentDistance2(&points[i], &points[first], &points[last]);
+
+        if (distance > farthestDistance)
+        {
+            farthestDistance = distance;
+            farthest = i;
+        }
+    }
+
+    if (farthest >= 0)
+    {
+        keep[farthest] = 1;
+        MarkPolyline(points, first, farthest, tolerance2, keep);
+        MarkPolyline(points, farthest, last, tolerance2, keep);
+    }
+}
+
+int SimplifyPolyline (MotionRecord *points, int count, int32_t tolerance)
+{
+    char *keep;
+    int i, kept = 0;
+
+    if (count <= 2 || tolerance <= 0)
+    {
+        return (count);
+    }
+
+    keep = calloc((size_t)count, 1);
+    if (!keep)
+    {
+        return (count);     // Not simplifying is always safe
+    }
+
+    keep[0] = 1;
+    keep[count - 1] = 1;
+    MarkPolyline(points, 0, count - 1, (double)tolerance * tolerance, keep);
+
+    for (i = 0; i < count; i++)
+    {
+        if (keep[i])
+        {
+            points[kept++] = points[i];
+        }
+    }
+
+    free(keep);
+    return (kept);
+}
+
+
+// Centre and radius of the circle through points first, middle and last of a run. Returns 0 if they are in a line.
+static int CircleThrough (const MotionRecord *a, const MotionRecord *b, const MotionRecord *c, double *centreX, double *centreY, double *radius)
+{
+    // Work relative to a so the products stay small
+    double bx = (double)b->x - a->x, by = (double)b->y - a->y;
+    double cx = (double)c->x - a->x, cy = (double)c->y - a->y;
+    double d = 2.0 * (bx * cy - by * cx);
+    double b2 = bx * bx + by * by;
+    double c2 = cx * cx + cy * cy;
+    double ux, uy;
+
+    if (fabs(d) < 1e-6)
+    {
+        return (0);
+    }
+
+    ux = (cy * b2 - by * c2) / d;
+    uy = (bx * c2 - cx * b2) / d;
+    *centreX = a->x + ux;
+    *centreY = a->y + uy;
+    *radius = sqrt(ux * ux + uy * uy);
+
+    return (1);
+}
+
+// Checks whether points[first..last] can be drawn as one arc without leaving the tolerance band around the
+// original lines. On success fills in the arc record that ends at points[last].
+static int ArcFits (const MotionRecord *points, int first, int last, double tolerance, MotionRecord *arc)
+{
+    double centreX, centreY, radius, sweep = 0.0, direction = 0.0;
+    int k;
+
+    if (!CircleThrough(&points[first], &points[(first + last) / 2], &points[last], &centreX, &centreY, &radius))
+    {
+        return (0);
+    }
+    if (radius > MOTION_MAX_ARC_OFFSET)
+    {
+        return (0);     // Too flat to be worth an arc, and the offset would not fit the record
+    }
+
+    for (k = first; k <= last; k++)
+    {
+        double dx = points[k].x - centreX;
+        double dy = points[k].y - centreY;
+
+        if (fabs(sqrt(dx * dx + dy * dy) - radius) > tolerance)
+        {
+            return (0);
+        }
+
+        if (k > first)
+        {
+            double px = points[k - 1].x - centreX;
+            double py = points[k - 1].y - centreY;
+            double delta = atan2(px * dy - py * dx, px * dx + py * dy);     // Angle turned from the previous point
+            double half = sqrt(px * px + py * py) * sin(fabs(delta) / 2.0);
+            double sagitta = radius - sqrt(radius * radius > half * half ? radius * radius - half * half : 0.0);
+
+            // Every step must turn the same way, and the arc may not bulge further than tolerance from the chord
+            if (delta == 0.0 || (direction != 0.0 && (delta > 0.0) != (direction > 0.0)) || sagitta > tolerance)
+            {
+                return (0);
+            }
+            direction = delta;
+            sweep += fabs(delta);
+        }
+    }
+
+    if (sweep >= 2.0 * 3.14159265358979323846)
+    {
+        return (0);
+    }
+
+    arc->x = points[last].x;
+    arc->y = points[last].y;
+    arc->i = (int16_t)lround(centreX - points[first].x);
+    arc->j = (int16_t)lround(centreY - points[first].y);
+    arc->op = direction > 0.0 ? MOTION_ARC_CCW : MOTION_ARC_CW;
+
+    // The points are already on the printed grid, so this is the arc exactly as the robot will be sent it
+    return ConformArc(points[first].x, points[first].y, arc, ENCODER_DECIMALS);
+}
+
+int FitArcs (const MotionRecord *points, int count, int32_t tolerance, MotionRecord *out)
+{
+    int start = 0, fitted = 0;
+
+    if (count <= 0)
+    {
+        return (0);
+    }
+
+    out[fitted++] = points[0];
+
+    while (start < count - 1)
+    {
+        MotionRecord arc, bestArc;
+        int end, bestEnd = -1;
+
+        // Grow the arc one point at a time for as long as it still fits
+        for (end = start + 2; end < count && ArcFits(points, start, end, tolerance, &arc); end++)
+        {
+            bestArc = arc;
+            bestEnd = end;
+        }
+
+        if (bestEnd >= 0)
+        {
+            out[fitted++] = bestArc;
+            start = bestEnd;
+        }
+        else
+        {
+            out[fitted++] = points[start + 1];
+            start++;
+        }
+    }
+
+    return (fitted);
+}
+
+
+// Scales one character from font units into micrometres, fits arcs and simplifies each pen down run
+static void BuildGlyph (GlyphCache *cache, const FontCharacter *character, Glyph *glyph)
+{
+    MotionRecord *scratch;
+    int k, start, count = 0;
+
+    glyph->built = 1;
+    glyph->records = malloc((size_t)(character->strokeTotal ? character->strokeTotal : 1) * sizeof(MotionRecord));
+    scratch = malloc((size_t)(character->strokeTotal ? character->strokeTotal : 1) * sizeof(MotionRecord));
+    if (!glyph->records || !scratch)
+    {
+        printf("Error: Unable to allocate memory for glyph %d.\n", character->asciiCode);
+        free(glyph->records);
+        free(scratch);
+        glyph->records = NULL;
+        return;
+    }
+
+    // Every point goes where the encoder will print it, so arcs can be checked here the way GRBL will check them
+    for (k = 0; k < character->strokeTotal; k++)
+    {
+        glyph->records[k].x = PrintedUnits(MotionFromMM(character->strokeData[k][0] * cache->scaleFactor), ENCODER_DECIMALS);
+        glyph->records[k].y = PrintedUnits(MotionFromMM(character->strokeData[k][1] * cache->scaleFactor), ENCODER_DECIMALS);
+        glyph->records[k].i = 0;
+        glyph->records[k].j = 0;
+        glyph->records[k].op = character->strokeData[k][2] ? MOTION_DRAW : MOTION_TRAVEL;
+    }
+    cache->fontPoints += character->strokeTotal;
+
+    // Each polyline runs from the point the pen goes down at through the following draw moves
+    for (start = 0; start < character->strokeTotal; )
+    {
+        int end = start + 1;
+
+        while (end < character->strokeTotal && glyph->records[end].op == MOTION_DRAW)
+        {
+            end++;
+        }
+
+        if (glyph->records[start].op == MOTION_DRAW)
+        {
+            // A glyph that starts with the pen down: keep its first point as it is
+            glyph->records[count++] = glyph->records[start];
+            start++;
+            continue;
+        }
+
+        {
+            int fitted, first, written = 0;
+
+            if (GLYPH_FIT_ARCS)
+            {
+                fitted = FitArcs(&glyph->records[start], end - start, cache->tolerance, scratch);
+            }
+            else
+            {
+                fitted = end - start;
+                memcpy(scratch, &glyph->records[start], (size_t)fitted * sizeof(MotionRecord));
+            }
+
+            // Simplify the straight parts left between arcs: each is a point followed by draw moves
+            for (first = 0; first < fitted; )
+            {
+                int last = first + 1;
+                int kept;
+
+                while (last < fitted && scratch[last].op == MOTION_DRAW)
+                {
+                    last++;
+                }
+                kept = SimplifyPolyline(&scratch[first], last - first, cache->tolerance);
+                memmove(&scratch[written], &scratch[first], (size_t)kept * sizeof(MotionRecord));
+                written += kept;
+                first = last;
+            }
+
+            for (k = 0; k < written; k++)
+            {
+                if (IsArc(scratch[k].op))
+                {
+                    cache->arcs++;
+                }
+            }
+            memcpy(&glyph->records[count], scratch, (size_t)written * sizeof(MotionRecord));
+            count += written;
+        }
+        start = end;
+    }
+
+    free(scratch);
+    glyph->count = count;
+    cache->keptPoints += count;
+}
+
+const Glyph *GetGlyph (GlyphCache *cache, int asciiCode)
+{
+    Glyph *glyph;
+    int j;
+
+    if (asciiCode < 0 || asciiCode >= MAX_ASCII)
+    {
+        return NULL;
+    }
+
+    glyph = &cache->glyphs[asciiCode];
+    if (!glyph->built)
+    {
+        for (j = 0; j < cache->characterCount; j++)
+        {
+            if (cache->fontArray[j].asciiCode == asciiCode) // Find the corresponding font data for the character
+            {
+                BuildGlyph(cache, &cache->fontArray[j], glyph);
+                break;
+            }
+        }
+        glyph->built = 1;
+    }
+
+    return glyph->records ? glyph : NULL;
+}
+
+int DrawGlyphWord (GlyphCache *cache, const char *word, double xPos, double yPos, MotionBuffer *motion)
+{
+    int32_t originY = PrintedUnits(MotionFromMM(yPos), ENCODER_DECIMALS);
+    int i, k;
+
+    for (i = 0; word[i] != '\0'; i++)
+    {
+        const Glyph *glyph = GetGlyph(cache, (unsigned char)word[i]);
+
+        if (glyph)
+        {
+            int32_t originX = PrintedUnits(MotionFromMM(xPos), ENCODER_DECIMALS);  // Each letter's origin is rounded on its own
+            MotionRecord *out = ExtendMotion(motion, (size_t)glyph->count);
+
+            if (!out)
+            {
+                return (-1);
+            }
+            for (k = 0; k < glyph->count; k++)
+            {
+                out[k] = glyph->records[k];     // Arcs keep their centre offsets, which are relative already
+                out[k].x += originX;
+                out[k].y += originY;
+            }
+            xPos += 15.0 * cache->scaleFactor;
+        }
+    }
+
+    return (0);
+}
+
+
+void PrintGlyphCacheStats (const GlyphCache *cache)
+{
+    printf("Glyph cache: tolerance %.3f mm, %ld font points drawn with %ld moves (%ld arcs)\n",
+           MotionToMM(cache->tolerance), cache->fontPoints, cache->keptPoints, cache->arcs);
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+#include "font.h"
+#include "motion.h"
+
+
+#ifndef GLYPH_H_INCLUDED
+#define GLYPH_H_INCLUDED
+
+
+#define GLYPH_MACHINE_RESOLUTION_MM 0.05        /* Smallest deviation the pen can actually show on paper */
+#define GLYPH_HEIGHT_TOLERANCE  0.0125          /* Simplification tolerance as a fraction of the text height: 0.05 mm at 4 mm, 0.125 mm at 10 mm */
+#define GLYPH_FIT_ARCS          1               /* 1 to replace runs of points on a circle with G2/G3 arcs, 0 for lines only */
+
+typedef struct
+{
+    MotionRecord *records;                      // Scaled moves relative to the character origin, in micrometres on the printed grid
+    int count;                                  // Number of moves
+    int built;                                  // 1 once the entry has been filled in
+} Glyph;
+
+typedef struct
+{
+    FontCharacter *fontArray;                   // Font the glyphs are built from
+    int characterCount;
+    double scaleFactor;                         // Font units to mm
+    int32_t tolerance;                          // Simplification tolerance in micrometres, 0 keeps every point
+    Glyph glyphs[MAX_ASCII];                    // Indexed by ASCII code, built the first time each character is drawn
+    long fontPoints;                            // Points in the font data of the glyphs built so far
+    long keptPoints;                            // Moves left after arc fitting and simplification
+    long arcs;                                  // Arc moves among them
+} GlyphCache;                                   // Scaled and simplified characters for one text height
+
+void StartGlyphCache (GlyphCache *cache, FontCharacter *fontArray, int characterCount, double scaleFactor);
+const Glyph *GetGlyph (GlyphCache *cache, int asciiCode);      // NULL if the font has no such character
+void FreeGlyphCache (GlyphCache *cache);
+
+// Appends the moves of word drawn at (xPos, yPos) to motion, a fixed advance per letter the font has.
+// Letter origins are rounded onto the printed grid, so every arc prints as it was checked. Returns -1 if out of memory.
+int DrawGlyphWord (GlyphCache *cache, const char *word, double xPos, double yPos, MotionBuffer *motion);
+void PrintGlyphCacheStats (const GlyphCache *cache);
+
+// Tolerance for a given text height: a fixed fraction of the height, but never finer than the machine can draw
+double SimplifyTolerance (double textHeight);
+
+// Replaces runs of pen down points that lie on a circle, within tolerance, with arc records. Only arcs GRBL
+// accepts as the encoder prints them are used, which is exact when the points are on the printed grid.
+// points[0] is where the pen goes down and is copied to out unchanged. Returns the number of records in out.
+int FitArcs (const MotionRecord *points, int count, int32_t tolerance, MotionRecord *out);
+
+// Douglas-Peucker simplification of one polyline in place. The first and last points are always kept.
+// Returns the new number of points.
+int SimplifyPolyline (MotionRecord *points, int count, int32_t tolerance);
+
+#endif // GLYPH_H_INCLUDED
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "grid.h"
+#include "encoder.h"
+
+
+static int32_t Snap (int32_t units, double stepsPerMm)
+{
+    double steps = floor((double)units * stepsPerMm / MOTION_UNITS_PER_MM + 0.5);
+
+    return (int32_t)floor(steps * MOTION_UNITS_PER_MM / stepsPerMm + 0.5);
+}
+
+static int DecimalsFor (double stepsPerMm)
+{
+    double step = 1.0 / stepsPerMm;     // mm
+    double unit = 1.0;
+    int decimals;
+
+    for (decimals = 0; decimals < GRID_MAX_DECIMALS; decimals++, unit /= 10.0)
+    {
+        double multiple = step / unit;
+
+        // Either every step prints exactly, or the printing error (half a unit) is under half a step
+        if (fabs(multiple - floor(multiple + 0.5)) < 1e-9 || unit < step)
+        {
+            break;
+        }
+    }
+    return decimals;
+}
+
+
+void StartMachineGrid (MachineGrid *grid, double stepsPerMmX, double stepsPerMmY)
+{
+    int decimalsX = DecimalsFor(stepsPerMmX);
+    int decimalsY = DecimalsFor(stepsPerMmY);
+
+    memset(grid, 0, sizeof(MachineGrid));
+    grid->stepsPerMmX = stepsPerMmX;
+    grid->stepsPerMmY = stepsPerMmY;
+    grid->decimals = decimalsX > decimalsY ? decimalsX : decimalsY;
+}
+
+
+void QuantizeMotion (MotionBuffer *motion, MachineGrid *grid)
+{
+    int32_t x = grid->penX, y = grid->penY;
+    int32_t rawX = grid->rawX, rawY = grid->rawY;
+    size_t kept = 0;
+    size_t dotAt = 0;               // Where the dot kept for the current stroke is, while dotHeld is set
+    int dotHeld = 0;
+    size_t k;
+
+    for (k = 0; k < motion->count; k++)
+    {
+        MotionRecord record = motion->records[k];
+
+        if (IsMove(record.op))
+        {
+            int32_t snappedX = Snap(record.x, grid->stepsPerMmX);
+            int32_t snappedY = Snap(record.y, grid->stepsPerMmY);
+            int32_t error = abs(snappedX - record.x) > abs(snappedY - record.y) ? abs(snappedX - record.x) : abs(snappedY - record.y);
+
+            if (error > grid->largestSnap)
+            {
+                grid->largestSnap = error;
+            }
+            grid->snapped++;
+
+            if (snappedX == x && snappedY == y)
+            {
+                rawX = record.x;
+                rawY = record.y;
+                if (record.op == MOTION_TRAVEL || grid->strokeDrawn)
+                {
+                    // Nothing left to draw or travel once both ends are on the same step
+                    grid->merged++;
+                    continue;
+                }
+
+                // The only draw of its stroke so far: keep it as a dot, or the pen would never go down here
+                record.op = MOTION_DRAW;
+                record.i = 0;
+                record.j = 0;
+                record.x = x;
+                record.y = y;
+                grid->strokeDrawn = 1;
+                dotAt = kept;
+                dotHeld = 1;
+                motion->records[kept++] = record;
+                continue;
+            }
+
+            if (record.op == MOTION_TRAVEL)
+            {
+                grid->strokeDrawn = 0;
+            }
+            else
+            {
+                grid->strokeDrawn = 1;
+                if (dotHeld && dotAt == kept - 1)
+                {
+                    kept--;                 // The stroke does go somewhere, so its dot is not needed after all
+                    grid->merged++;
+                }
+                dotHeld = 0;
+            }
+
+            if (IsArc(record.op))
+            {
+                // Keep the centre as close as possible to where it was, but the same distance from both
+                // snapped ends: project it onto the perpendicular bisector of the new chord
+                double centreX = (double)rawX + record.i;
+                double centreY = (double)rawY + record.j;
+                double midX = 0.5 * ((double)x + snappedX);
+                double midY = 0.5 * ((double)y + snappedY);
+                double chordX = (double)snappedX - x;
+                double chordY = (double)snappedY - y;
+                double length = sqrt(chordX * chordX + chordY * chordY);
+                double normalX = -chordY / length;
+                double normalY = chordX / length;
+                double along = (centreX - midX) * normalX + (centreY - midY) * normalY;
+                double i = midX + along * normalX - x;
+                double j = midY + along * normalY - y;
+
+                MotionRecord snapped = record;
+
+                snapped.x = snappedX;
+                snapped.y = snappedY;
+                if (fabs(i) <= MOTION_MAX_ARC_OFFSET && fabs(j) <= MOTION_MAX_ARC_OFFSET)
+                {
+                    snapped.i = (int16_t)floor(i + 0.5);
+                    snapped.j = (int16_t)floor(j + 0.5);
+                }
+                if (fabs(i) > MOTION_MAX_ARC_OFFSET || fabs(j) > MOTION_MAX_ARC_OFFSET || !ConformArc(x, y, &snapped, grid->decimals))
+                {
+                    record.op = MOTION_DRAW;
+                    record.i = 0;
+                    record.j = 0;
+                    grid->arcsToLines++;
+                }
+                else
+                {
+                    record.i = snapped.i;
+                    record.j = snapped.j;
+                }
+            }
+
+            rawX = record.x;
+            rawY = record.y;
+            record.x = snappedX;
+            record.y = snappedY;
+            x = snappedX;
+            y = snappedY;
+        }
+        else if (record.op == MOTION_PEN_UP || record.op == MOTION_PEN_DOWN)
+        {
+            record.x = x;
+            record.y = y;
+        }
+
+        motion->records[kept++] = record;
+    }
+
+    motion->count = kept;
+    grid->penX = x;
+    grid->penY = y;
+    grid->rawX = rawX;
+    grid->rawY = rawY;
+}
+
+
+void PrintMachineGridStats (const MachineGrid *grid)
+{
+    printf("Machine grid: %.1f x %.1f steps/mm, %d decimals, %ld moves snapped (largest %.1f um), %ld merged, %ld arcs sent as lines\n",
+           grid->stepsPerMmX, grid->stepsPerMmY, grid->decimals, grid->snapped,
+           (double)grid->largestSnap * 1000.0 / MOTION_UNITS_PER_MM, grid->merged, grid->arcsToLines);
+}
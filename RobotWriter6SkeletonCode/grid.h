@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef GRID_H_INCLUDED
+#define GRID_H_INCLUDED
+
+
+#define GRID_STEPS_PER_MM_X     80.0            /* Motor steps per mm on X, the controller's $100 setting */
+#define GRID_STEPS_PER_MM_Y     80.0            /* Motor steps per mm on Y, the controller's $101 setting */
+#define GRID_MAX_DECIMALS       3               /* Finest output precision; records only hold micrometres */
+
+typedef struct
+{
+    double stepsPerMmX, stepsPerMmY;
+    int decimals;                               // Decimal places the encoder needs so the robot lands on the same step
+    long snapped;                               // Moves that were snapped
+    long merged;                                // Moves dropped because they snapped onto the point before them
+    long arcsToLines;                           // Arcs whose centre no longer fit once snapped, or that GRBL would refuse as printed, sent as straight lines
+    int32_t largestSnap;                        // Furthest any end point moved, in micrometres
+    int32_t penX, penY;                         // Snapped pen position after the last move; the origin is on every grid
+    int32_t rawX, rawY;                         // Where the layout had the pen, which arc centres are relative to
+    int strokeDrawn;                            // Set once a draw of the current stroke has been kept
+} MachineGrid;                                  // The positions the steppers can actually reach
+
+// Sets the grid up and picks the output precision: the fewest decimals for which printing a snapped value
+// is either exact or off by less than half a step, so the controller rounds it to the same step.
+void StartMachineGrid (MachineGrid *grid, double stepsPerMmX, double stepsPerMmY);
+
+// Snaps every move of the job to the nearest step, in place, and drops moves that end up where the pen
+// already is, except the only draw of a stroke, which is kept as a dot. The pen position carries over between calls, so a job snapped in consecutive pieces comes out
+// the same as snapped whole. Error bounds, per end point: at most half a step on each axis, plus half a micrometre of
+// storage rounding (6.75 um on each axis at 80 steps/mm); what is printed then lands on exactly that step.
+// An arc's centre is moved onto the bisector of its snapped chord, so its start and end radii still agree, then aimed
+// from the start as printed (see ConformArc). One that GRBL would still refuse is drawn as a straight line,
+// and an arc that snaps to zero length is dropped, or drawn as a dot, rather than turning into a full circle.
+void QuantizeMotion (MotionBuffer *motion, MachineGrid *grid);
+
+void PrintMachineGridStats (const MachineGrid *grid);
+
+#endif // GRID_H_INCLUDED
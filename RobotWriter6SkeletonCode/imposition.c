@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "imposition.h"
+
+
+int BuildPlacementGrid (const MotionBuffer *job, int columns, int rows, double gap, double rotationDeg, Placement *placements)
+{
+    double angle = rotationDeg * 3.14159265358979323846 / 180.0;
+    double c = cos(angle);
+    double s = sin(angle);
+    double minX = 0.0, maxX = 0.0, minY = 0.0, maxY = 0.0;
+    double cellWidth, cellHeight;
+    int total = columns * rows;
+    size_t i, moves = 0, firstMove = 0, lastMove = 0;
+    int placed;
+
+    // Bounding box of the rotated job, this is the size of one grid cell before the gap
+    for (i = 0; i < job->count; i++)
+    {
+        double x = c * MotionToMM(job->records[i].x) - s * MotionToMM(job->records[i].y);
+        double y = s * MotionToMM(job->records[i].x) + c * MotionToMM(job->records[i].y);
+
+        if (!IsMove(job->records[i].op))
+        {
+            continue;       // Markers do not take up any room on the sheet
+        }
+        if (moves == 0)
+        {
+            firstMove = i;
+        }
+        lastMove = i;
+
+        if (moves == 0 || x < minX) minX = x;
+        if (moves == 0 || x > maxX) maxX = x;
+        if (moves == 0 || y < minY) minY = y;
+        if (moves == 0 || y > maxY) maxY = y;
+        moves++;
+    }
+
+    if (moves == 0 || total <= 0)
+    {
+        return (0);
+    }
+    cellWidth = (maxX - minX) + gap;
+    cellHeight = (maxY - minY) + gap;
+
+    // Cells run left to right and downwards, the same direction text is laid out in
+    for (placed = 0; placed < total; placed++)
+    {
+        int column = placed % columns;
+        int row = placed / columns;
+
+        placements[placed].xx = c;
+        placements[placed].xy = -s;
+        placements[placed].yx = s;
+        placements[placed].yy = c;
+        placements[placed].offsetX = column * cellWidth - minX;    // Top left of the rotated box goes to the cell corner
+        placements[placed].offsetY = -row * cellHeight - maxY;
+    }
+
+    // Nearest neighbour ordering: from where the last copy finished, go to the copy whose first move is closest.
+    // The number of copies on a sheet is small, so the simple quadratic search is plenty.
+    {
+        const MotionRecord *first = &job->records[firstMove];
+        const MotionRecord *last = &job->records[lastMove];
+        double penX = 0.0, penY = 0.0;      // Copies start from the origin, where the robot is homed
+
+        for (placed = 0; placed < total; placed++)
+        {
+            int bestIndex = placed;
+            int candidate;
+            double bestDistance = -1.0;
+
+            for (candidate = placed; candidate < total; candidate++)
+            {
+                double startX, startY, distance;
+
+                TransformPoint(&placements[candidate], MotionToMM(first->x), MotionToMM(first->y), &startX, &startY);
+                distance = (startX - penX) * (startX - penX) + (startY - penY) * (startY - penY);
+                if (bestDistance < 0.0 || distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = candidate;
+                }
+            }
+
+            if (bestIndex != placed)
+            {
+                Placement swap = placements[placed];
+                placements[placed] = placements[bestIndex];
+                placements[bestIndex] = swap;
+            }
+            TransformPoint(&placements[placed], MotionToMM(last->x), MotionToMM(last->y), &penX, &penY);
+        }
+    }
+
+    return (total);
+}
+
+
+int StampMotion (const MotionBuffer *job, const Placement *placement, MotionBuffer *sheet)
+{
+    size_t i;
+
+    for (i = 0; i < job->count; i++)
+    {
+        MotionRecord record = job->records[i];
+        double x, y;
+
+        TransformPoint(placement, MotionToMM(record.x), MotionToMM(record.y), &x, &y);
+        record.x = MotionFromMM(x);
+        record.y = MotionFromMM(y);
+        if (IsArc(record.op))
+        {
+            // The centre offset is a direction, so it only turns with the copy and is not shifted
+            double offsetI = placement->xx * record.i + placement->xy * record.j;
+            double offsetJ = placement->yx * record.i + placement->yy * record.j;
+
+            record.i = (int16_t)(offsetI >= 0.0 ? offsetI + 0.5 : offsetI - 0.5);
+            record.j = (int16_t)(offsetJ >= 0.0 ? offsetJ + 0.5 : offsetJ - 0.5);
+        }
+        if (AppendMotionRecord(sheet, &record) != 0)
+        {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef IMPOSITION_H_INCLUDED
+#define IMPOSITION_H_INCLUDED
+
+
+#define IMPOSITION_COLUMNS      2               /* Number of copies across the sheet */
+#define IMPOSITION_ROWS         4               /* Number of copies down the sheet */
+#define IMPOSITION_GAP_MM       5.0             /* Clear space left between neighbouring copies */
+#define IMPOSITION_ROTATION_DEG 0.0             /* Rotation applied to every copy, anticlockwise */
+
+typedef struct
+{
+    double xx, xy, yx, yy;                      // Rotation part: x' = xx*x + xy*y + offsetX
+    double offsetX, offsetY;                    //                y' = yx*x + yy*y + offsetY
+} Placement;                                    // Where one copy of the job lands on the sheet
+
+// Fills placements[] with columns * rows copies of job on a grid, ordered so the pen-up travel
+// from the end of one copy to the start of the next is short. Returns the number of placements.
+int BuildPlacementGrid (const MotionBuffer *job, int columns, int rows, double gap, double rotationDeg, Placement *placements);
+
+// Appends a copy of job, moved to placement, to the end of sheet. Returns -1 if out of memory.
+int StampMotion (const MotionBuffer *job, const Placement *placement, MotionBuffer *sheet);
+
+static inline void TransformPoint (const Placement *placement, double x, double y, double *outX, double *outY)
+{
+    *outX = placement->xx * x + placement->xy * y + placement->offsetX;
+    *outY = placement->yx * x + placement->yy * y + placement->offsetY;
+}
+
+#endif // IMPOSITION_H_INCLUDED
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job.h"
+
+
+// Runs the layout until the next word is in wordMotion, checked and snapped, or the text runs out
+static void AdvanceText (JobGenerator *job)
+{
+    ClearMotion(&job->wordMotion);
+    job->nextStep = 0;
+
+    while (job->wordMotion.count == 0 && job->state == JOB_LAYING_OUT)
+    {
+        LayoutEvent event = AdvanceLayout(&job->layout, &job->wordMotion);
+
+        if (event == LAYOUT_ERROR)
+        {
+            job->failed = 1;        // Whatever was laid out before the error still goes
+        }
+        if (event == LAYOUT_ERROR || event == LAYOUT_END)
+        {
+            job->state = JOB_FINISHING;
+        }
+    }
+
+    if (job->wordMotion.count > 0)
+    {
+        JobBounds bounds;
+
+        MeasureJob(&job->wordMotion, &bounds);
+        if (!JobFitsLimits(&bounds, &job->limits))
+        {
+            PrintJobBounds(&bounds, &job->limits);
+            printf("Error: The job would leave the work area, nothing more has been sent.\n");
+            ClearMotion(&job->wordMotion);
+            job->failed = 1;
+            job->state = JOB_FINISHING;
+        }
+    }
+    if (job->snapToGrid)
+    {
+        QuantizeMotion(&job->wordMotion, &job->grid);      // After the check, as the batch pipeline does
+    }
+}
+
+// Passes steps through pen tracking and the peephole optimizer until something comes out for the encoder
+static void FillQueue (JobGenerator *job)
+{
+    MotionRecord steps[PEN_MAX_STEPS];
+    MotionRecord ready[PEEPHOLE_WINDOW];
+    int stepCount, k;
+
+    while (job->queued == 0 && job->state != JOB_DONE)
+    {
+        if (job->nextStep < job->wordMotion.count)
+        {
+            stepCount = TrackPen(&job->pen, &job->wordMotion.records[job->nextStep++], steps);
+        }
+        else if (job->state == JOB_FINISHING || job->failed)
+        {
+            // Lift the pen, even after an error, and let everything the peephole optimizer still holds go
+            int readyCount;
+
+            stepCount = FinishPen(&job->pen, steps);
+            for (k = 0; k < stepCount; k++)
+            {
+                if (PushPeephole(&job->peephole, &steps[k], ready))
+                {
+                    job->queue[job->queued++] = ready[0];
+                }
+            }
+            readyCount = FlushPeephole(&job->peephole, ready);
+            for (k = 0; k < readyCount; k++)
+            {
+                job->queue[job->queued++] = ready[k];
+            }
+            job->queueHead = 0;
+            job->state = JOB_DONE;
+            return;
+        }
+        else
+        {
+            AdvanceText(job);
+            continue;
+        }
+
+        job->queueHead = 0;
+        for (k = 0; k < stepCount; k++)
+        {
+            if (PushPeephole(&job->peephole, &steps[k], ready))
+            {
+                job->queue[job->queued++] = ready[0];
+            }
+        }
+    }
+}
+
+
+JobGenerator *BeginJob (const char *text, FontCharacter *fontArray, int characterCount, double textHeight, const JobSettings *settings)
+{
+    JobGenerator *job = calloc(1, sizeof(JobGenerator));
+    int decimals = ENCODER_DECIMALS;
+
+    if (!job)
+    {
+        printf("Error: Unable to allocate memory for the job.\n");
+        return NULL;
+    }
+
+    job->state = JOB_LAYING_OUT;
+    StartTextLayout(&job->layout, text, fontArray, characterCount, textHeight / FONT_HEIGHT_UNITS, settings->optimalBreaks);
+    job->snapToGrid = settings->machineGrid;
+    if (job->snapToGrid)
+    {
+        StartMachineGrid(&job->grid, GRID_STEPS_PER_MM_X, GRID_STEPS_PER_MM_Y);
+        decimals = job->grid.decimals;
+    }
+    DefaultSoftLimits(&job->limits);
+    StartPenTracker(&job->pen);
+    StartPeephole(&job->peephole, decimals);
+    StartEncoder(&job->encoder, settings->modal, decimals);
+    job->settleMs = LoadPenSettle();
+
+    return job;
+}
+
+int NextJobCommand (JobGenerator *job, JobCommand *command)
+{
+    for (;;)
+    {
+        if (job->dwellPending)
+        {
+            job->dwellPending = 0;
+            command->record = job->dwell;
+            command->length = EncodeStep(&job->encoder, &job->dwell, job->line);
+            command->text = job->line;
+            job->commands++;
+            return (1);
+        }
+        if (job->queued == 0)
+        {
+            FillQueue(job);
+            if (job->queued == 0)
+            {
+                return (0);     // Done, or stopped by an error
+            }
+        }
+
+        command->record = job->queue[job->queueHead++];
+        job->queued--;
+        command->length = EncodeStep(&job->encoder, &command->record, job->line);
+        if (command->length > 0)
+        {
+            if (command->record.op == MOTION_PEN_UP || command->record.op == MOTION_PEN_DOWN)
+            {
+                job->dwellPending = SettleDwell(job->settleMs, &command->record, &job->dwell);
+            }
+            command->text = job->line;
+            job->commands++;
+            return (1);
+        }
+    }
+}
+
+int JobFailed (const JobGenerator *job)
+{
+    return job->failed;
+}
+
+void PrintJobStats (const JobGenerator *job)
+{
+    PrintGlyphCacheStats(&job->layout.glyphs);
+    if (job->snapToGrid)
+    {
+        PrintMachineGridStats(&job->grid);
+    }
+    printf("Pen lifts: %ld, pen drops: %ld, lifts saved: %ld\n", job->pen.penLifts, job->pen.penDrops, job->pen.liftsSaved);
+    PrintPeepholeStats(&job->peephole);
+    PrintEncoderStats(&job->encoder);
+}
+
+void EndJob (JobGenerator *job)
+{
+    if (job)
+    {
+        FreeTextLayout(&job->layout);
+        FreeMotion(&job->wordMotion);
+        free(job);
+    }
+}
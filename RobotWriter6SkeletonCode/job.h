@@ -0,0 +1,76 @@
+#include <stdio.h>
+
+#include "font.h"
+#include "motion.h"
+#include "layout.h"
+#include "grid.h"
+#include "bounds.h"
+#include "pen.h"
+#include "peephole.h"
+#include "encoder.h"
+#include "settle.h"
+
+
+#ifndef JOB_H_INCLUDED
+#define JOB_H_INCLUDED
+
+
+#define JOB_QUEUE               (PEEPHOLE_WINDOW + PEN_MAX_STEPS) /* Steps released by the optimizers but not yet encoded */
+
+typedef enum
+{
+    JOB_LAYING_OUT,                             // Taking the text a word at a time from the layout
+    JOB_FINISHING,                              // The text has run out, the pen still has to come up
+    JOB_DONE                                    // Every command has been handed out
+} JobState;
+
+typedef struct
+{
+    int optimalBreaks;                          // 1 to lay out each paragraph with the line breaker; the lookahead becomes a paragraph
+    int modal;                                  // 1 to leave out G words and coordinates the robot already has
+    int machineGrid;                            // 1 to snap every point to the robot's step grid and print only the decimals that needs
+} JobSettings;                                  // The batch toggles the generator can follow, so both send the same G-code
+
+typedef struct
+{
+    const char *text;                           // The G-code line, newline terminated, valid until the next call
+    int length;                                 // Its length in bytes
+    MotionRecord record;                        // The step it encodes
+} JobCommand;
+
+typedef struct
+{
+    JobState state;
+    int failed;                                 // Set if the text has a character the font cannot draw, leaves the work area, or memory ran out
+    TextLayout layout;                          // The same word by word layout the batch pipeline uses
+    int snapToGrid;                             // Set if every word is snapped to grid before it goes out
+    MachineGrid grid;
+    SoftLimits limits;                          // Every word is checked against these before any of it is sent
+    MotionBuffer wordMotion;                    // Steps of the current word, or paragraph: the whole of the lookahead
+    size_t nextStep;                            // Next step of wordMotion to feed in
+    PenTracker pen;
+    Peephole peephole;
+    GCodeEncoder encoder;
+    MotionRecord queue[JOB_QUEUE];              // Steps out of the peephole optimizer, oldest first
+    int queued, queueHead;
+    int settleMs;                               // Dwell after each pen change, from the calibration
+    int dwellPending;                           // Set when the command handed out last was a pen change and dwell comes next
+    MotionRecord dwell;
+    char line[ENCODER_MAX_LINE];                // The command handed out last
+    long commands;                              // Commands handed out
+} JobGenerator;                                 // Produces a job's G-code one command at a time, on demand
+
+// Starts generating the G-code for text at the given height. Nothing is laid out until commands are asked
+// for, and at most one word (one paragraph with optimal line breaks) is held at any time, so memory does not
+// grow with the length of the text. The caller still sends the preamble (G1 X0 Y0 F1000, M3, S0) first.
+// Returns NULL if out of memory.
+JobGenerator *BeginJob (const char *text, FontCharacter *fontArray, int characterCount, double textHeight, const JobSettings *settings);
+
+// Fills in the next command and returns 1, or returns 0 once the job is complete or has failed
+int NextJobCommand (JobGenerator *job, JobCommand *command);
+
+int JobFailed (const JobGenerator *job);
+void PrintJobStats (const JobGenerator *job);
+void EndJob (JobGenerator *job);
+
+#endif // JOB_H_INCLUDED
@@ -0,0 +1,812 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobfile.h"
+#include "motion.h"
+
+
+#define CHECKPOINT_SIZE         17              /* Bytes per index entry: offset, x, y and pen */
+
+static const int StepUnits[4] = { 1000, 100, 10, 1 };     // Micrometres per last printed digit, by decimals
+
+static unsigned char *PutLittle (unsigned char *out, unsigned long long value, int bytes)
+{
+    int k;
+
+    for (k = 0; k < bytes; k++)
+    {
+        *out++ = (unsigned char)(value >> (8 * k));
+    }
+    return out;
+}
+
+static unsigned long long GetLittle (const unsigned char *in, int bytes)
+{
+    unsigned long long value = 0;
+    int k;
+
+    for (k = 0; k < bytes; k++)
+    {
+        value |= (unsigned long long)in[k] << (8 * k);
+    }
+    return value;
+}
+
+// Zigzag maps small negative and positive numbers alike to small unsigned ones: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+static unsigned long long Zigzag (long long value)
+{
+    return value < 0 ? ((unsigned long long)(-(value + 1)) << 1) | 1 : (unsigned long long)value << 1;
+}
+
+static long long Unzigzag (unsigned long long value)
+{
+    return (value & 1) ? -(long long)(value >> 1) - 1 : (long long)(value >> 1);
+}
+
+static unsigned char *PutVarint (unsigned char *out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+
+//// Writing ////
+
+static void FlushJobWriter (JobWriter *writer)
+{
+    if (writer->used > 0 && !writer->failed && fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used)
+    {
+        printf("Error: Unable to write the job file.\n");
+        writer->failed = 1;
+    }
+    writer->used = 0;
+}
+
+static void PutBytes (JobWriter *writer, const unsigned char *bytes, size_t length)
+{
+    if (writer->used + length > JOBFILE_BUFFER)
+    {
+        FlushJobWriter(writer);
+    }
+    memcpy(&writer->buffer[writer->used], bytes, length);
+    writer->used += length;
+    writer->bytes += (long long)length;
+}
+
+static void PutHeader (JobWriter *writer, unsigned char *header, long long indexOffset)
+{
+    unsigned char *out = header;
+
+    memcpy(out, JOBFILE_MAGIC, 4);
+    out += 4;
+    *out++ = (unsigned char)writer->encoder.decimals;
+    *out++ = (unsigned char)writer->encoder.modal;
+    out = PutLittle(out, JOBFILE_CHECKPOINT, 2);
+    out = PutLittle(out, (unsigned long)writer->commands, 4);
+    out = PutLittle(out, (unsigned long)writer->checkpointCount, 4);
+    out = PutLittle(out, (unsigned long)writer->pageCount, 4);
+    out = PutLittle(out, (unsigned long)MotionFromMM(JOBFILE_PAGE_HEIGHT), 4);
+    PutLittle(out, (unsigned long long)indexOffset, 8);
+}
+
+
+int OpenJobWriter (JobWriter *writer, const char *path, int modal, int decimals)
+{
+    unsigned char header[JOBFILE_HEADER_SIZE];
+
+    memset(writer, 0, sizeof(*writer));
+    if (decimals < 0 || decimals > 3)
+    {
+        printf("Error: A job file can hold 0 to 3 decimals, not %d\n", decimals);
+        return (-1);
+    }
+
+    writer->buffer = malloc(JOBFILE_BUFFER);
+    if (!writer->buffer)
+    {
+        printf("Error: Unable to allocate memory for the job file.\n");
+        return (-1);
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        printf("Error: Could not create %s\n", path);
+        free(writer->buffer);
+        writer->buffer = NULL;
+        return (-1);
+    }
+
+    StartEncoder(&writer->encoder, modal, decimals);
+    writer->unit = StepUnits[decimals];
+    writer->motionMode = -1;
+    writer->pageCount = 1;          // Page 0 starts with the first command
+
+    // The counts and the index position are patched in once the job is complete
+    PutHeader(writer, header, 0);
+    PutBytes(writer, header, sizeof(header));
+    return (0);
+}
+
+// A coordinate such as 12, -3.5, .25 or -.125, in micrometres. Returns -1 for anything else,
+// including more than three decimals, which no record could hold.
+static int ParseCoordinate (const char **text, const char *end, int32_t *units)
+{
+    const char *p = *text;
+    long long value = 0;
+    int negative = 0, digits = 0, decimals = 0;
+
+    if (p < end && *p == '-')
+    {
+        negative = 1;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p++ - '0');
+        if (++digits > 7)
+        {
+            return (-1);
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (++decimals > 3)
+            {
+                return (-1);
+            }
+            value = value * 10 + (*p++ - '0');
+            digits++;
+        }
+    }
+    if (digits == 0)
+    {
+        return (-1);
+    }
+    while (decimals++ < 3)
+    {
+        value *= 10;
+    }
+
+    *units = (int32_t)(negative ? -value : value);
+    *text = p;
+    return (0);
+}
+
+// Reads a line the way the encoder writes it: G0 to G3 with X, Y, I and J, G4 with P, or S on its own.
+// Words left out of a modal line are filled in from what came before. Returns 0 if the line
+// is something else, to be kept as text.
+static int ParseJobLine (const JobWriter *writer, const char *text, size_t length, MotionRecord *record)
+{
+    const char *p = text, *end = text + length;
+    int32_t value[26];
+    int seen[26] = {0};
+    int mode;
+
+    if (length == 0 || text[length - 1] != '\n')
+    {
+        return (0);
+    }
+    end--;
+
+    while (p < end)
+    {
+        int letter;
+
+        if (*p == ' ')
+        {
+            p++;
+            continue;
+        }
+        if (*p < 'A' || *p > 'Z')
+        {
+            return (0);
+        }
+        letter = *p++ - 'A';
+        if (seen[letter] || ParseCoordinate(&p, end, &value[letter]) != 0)
+        {
+            return (0);
+        }
+        seen[letter] = 1;
+    }
+
+    record->x = writer->x;
+    record->y = writer->y;
+    record->i = 0;
+    record->j = 0;
+
+    if (seen['S' - 'A'])
+    {
+        if (seen['G' - 'A'] || seen['X' - 'A'] || seen['Y' - 'A'] || seen['I' - 'A'] || seen['J' - 'A'])
+        {
+            return (0);
+        }
+        record->op = value['S' - 'A'] == 0 ? MOTION_PEN_UP : MOTION_PEN_DOWN;
+        return (1);
+    }
+
+    // G is parsed in micrometres too, so G1 reads as 1000, and P in seconds comes out in milliseconds
+    if (seen['G' - 'A'] && value['G' - 'A'] == 4000)
+    {
+        if (!seen['P' - 'A'] || value['P' - 'A'] < 0 || value['P' - 'A'] > INT16_MAX
+            || seen['X' - 'A'] || seen['Y' - 'A'] || seen['I' - 'A'] || seen['J' - 'A'])
+        {
+            return (0);
+        }
+        record->op = MOTION_DWELL;
+        record->i = (int16_t)value['P' - 'A'];
+        return (1);
+    }
+    mode = seen['G' - 'A'] ? value['G' - 'A'] / 1000 : writer->motionMode;
+    if ((seen['G' - 'A'] && value['G' - 'A'] % 1000 != 0) || mode < 0 || mode > 3)
+    {
+        return (0);
+    }
+    record->op = (uint8_t)(mode == 0 ? MOTION_TRAVEL : mode == 1 ? MOTION_DRAW : mode == 2 ? MOTION_ARC_CW : MOTION_ARC_CCW);
+    if (seen['X' - 'A']) record->x = value['X' - 'A'];
+    if (seen['Y' - 'A']) record->y = value['Y' - 'A'];
+    if (seen['I' - 'A']) record->i = (int16_t)value['I' - 'A'];
+    if (seen['J' - 'A']) record->j = (int16_t)value['J' - 'A'];
+    if ((seen['I' - 'A'] && record->i != value['I' - 'A']) || (seen['J' - 'A'] && record->j != value['J' - 'A']))
+    {
+        return (0);     // Too large for a record
+    }
+    return (1);
+}
+
+void WriteJobCommand (JobWriter *writer, const char *text, size_t length)
+{
+    unsigned char command[JOBFILE_MAX_COMMAND];
+    unsigned char *out = command;
+    MotionRecord record;
+    int stored = 0;
+
+    if (writer->failed)
+    {
+        return;
+    }
+
+    if (writer->commands % JOBFILE_CHECKPOINT == 0)
+    {
+        if (writer->checkpointCount == writer->checkpointCapacity)
+        {
+            long newCapacity = writer->checkpointCapacity ? writer->checkpointCapacity * 2 : 64;
+            JobCheckpoint *newCheckpoints = realloc(writer->checkpoints, (size_t)newCapacity * sizeof(JobCheckpoint));
+
+            if (!newCheckpoints)
+            {
+                printf("Error: Unable to allocate memory for the job file index.\n");
+                writer->failed = 1;
+                return;
+            }
+            writer->checkpoints = newCheckpoints;
+            writer->checkpointCapacity = newCapacity;
+        }
+        writer->checkpoints[writer->checkpointCount].offset = writer->bytes;
+        writer->checkpoints[writer->checkpointCount].x = writer->x;
+        writer->checkpoints[writer->checkpointCount].y = writer->y;
+        writer->checkpoints[writer->checkpointCount].penDown = writer->penDown;
+        writer->checkpointCount++;
+    }
+
+    if (ParseJobLine(writer, text, length, &record))
+    {
+        // Only keep the record if the reader's encoder, in the same state, will print this very line
+        GCodeEncoder check = writer->encoder;
+        char line[ENCODER_MAX_LINE];
+        int unit = writer->unit;
+
+        if (record.x % unit == 0 && record.y % unit == 0
+            && (record.op == MOTION_DWELL || (record.i % unit == 0 && record.j % unit == 0))
+            && EncodeStep(&check, &record, line) == (int)length && memcmp(line, text, length) == 0)
+        {
+            int tag = record.op;
+
+            writer->encoder = check;
+            stored = 1;
+
+            if (IsMove(record.op))
+            {
+                unsigned char *tagByte = out++;
+
+                if (record.x != writer->x)
+                {
+                    tag |= JOBFILE_HAS_X;
+                    out = PutVarint(out, Zigzag(((long long)record.x - writer->x) / unit));
+                }
+                if (record.y != writer->y)
+                {
+                    tag |= JOBFILE_HAS_Y;
+                    out = PutVarint(out, Zigzag(((long long)record.y - writer->y) / unit));
+                }
+                if (IsArc(record.op))
+                {
+                    out = PutVarint(out, Zigzag(record.i / unit));
+                    out = PutVarint(out, Zigzag(record.j / unit));
+                }
+                *tagByte = (unsigned char)tag;
+
+                writer->x = record.x;
+                writer->y = record.y;
+                writer->motionMode = record.op == MOTION_TRAVEL ? 0 : record.op == MOTION_DRAW ? 1 : record.op == MOTION_ARC_CW ? 2 : 3;
+
+                // Text runs down the page from y = 0, so each page starts at the first move below the one before
+                while (record.y < 0 && writer->pageCount < JOBFILE_MAX_PAGES
+                       && -MotionToMM(record.y) >= writer->pageCount * JOBFILE_PAGE_HEIGHT)
+                {
+                    writer->pages[writer->pageCount++] = writer->commands;
+                }
+            }
+            else if (record.op == MOTION_DWELL)
+            {
+                *out++ = (unsigned char)tag;
+                out = PutVarint(out, (unsigned long long)record.i);
+            }
+            else
+            {
+                *out++ = (unsigned char)tag;        // A pen change is the tag alone
+                writer->penDown = record.op == MOTION_PEN_DOWN;
+            }
+        }
+    }
+
+    if (!stored)
+    {
+        if (length >= GCODE_MAX_LINE)
+        {
+            printf("Error: A line of %d bytes is too long for a job file\n", (int)length);
+            writer->failed = 1;
+            return;
+        }
+        *out++ = JOBFILE_RAW;
+        out = PutVarint(out, length);
+        memcpy(out, text, length);
+        out += length;
+        writer->raw++;
+    }
+
+    PutBytes(writer, command, (size_t)(out - command));
+    writer->commands++;
+    writer->textBytes += (long long)length;
+}
+
+int CloseJobWriter (JobWriter *writer)
+{
+    unsigned char header[JOBFILE_HEADER_SIZE];
+    unsigned char entry[CHECKPOINT_SIZE];
+    long long indexOffset = writer->bytes;
+    long k;
+    int failed;
+
+    for (k = 0; k < writer->checkpointCount && !writer->failed; k++)
+    {
+        const JobCheckpoint *checkpoint = &writer->checkpoints[k];
+        unsigned char *out = PutLittle(entry, (unsigned long long)checkpoint->offset, 8);
+
+        out = PutLittle(out, (uint32_t)checkpoint->x, 4);
+        out = PutLittle(out, (uint32_t)checkpoint->y, 4);
+        *out = (unsigned char)checkpoint->penDown;
+        PutBytes(writer, entry, CHECKPOINT_SIZE);
+    }
+    for (k = 0; k < writer->pageCount && !writer->failed; k++)
+    {
+        PutLittle(entry, (unsigned long)writer->pages[k], 4);
+        PutBytes(writer, entry, 4);
+    }
+    FlushJobWriter(writer);
+
+    if (!writer->failed)
+    {
+        PutHeader(writer, header, indexOffset);
+        if (fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), writer->file) != sizeof(header))
+        {
+            printf("Error: Unable to write the job file.\n");
+            writer->failed = 1;
+        }
+    }
+    if (fclose(writer->file) != 0 && !writer->failed)
+    {
+        printf("Error: Unable to write the job file.\n");
+        writer->failed = 1;
+    }
+    failed = writer->failed;
+
+    if (!failed)
+    {
+        printf("Job file: %ld commands (%ld kept as text), %d pages, %lld bytes, %.2f bytes per command, "
+               "%.1f times smaller than the G-code\n",
+               writer->commands, writer->raw, writer->pageCount, writer->bytes,
+               writer->commands > 0 ? (double)writer->bytes / writer->commands : 0.0,
+               writer->bytes > 0 ? (double)writer->textBytes / writer->bytes : 0.0);
+    }
+
+    free(writer->buffer);
+    free(writer->checkpoints);
+    writer->file = NULL;
+    writer->buffer = NULL;
+    writer->checkpoints = NULL;
+    return failed ? -1 : 0;
+}
+
+
+//// Reading ////
+
+static void FillJobReader (JobReader *reader)
+{
+    size_t unread = reader->end - reader->start;
+    size_t got;
+
+    memmove(reader->buffer, &reader->buffer[reader->start], unread);
+    reader->start = 0;
+    reader->end = unread;
+
+    got = fread(&reader->buffer[reader->end], 1, JOBFILE_BUFFER - reader->end, reader->file);
+    reader->end += got;
+    if (got == 0)
+    {
+        reader->atEnd = 1;
+    }
+}
+
+static int GetVarint (JobReader *reader, unsigned long long *value)
+{
+    int shift;
+
+    *value = 0;
+    for (shift = 0; shift < 64 && reader->start < reader->end; shift += 7)
+    {
+        unsigned char byte = reader->buffer[reader->start++];
+
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return (0);
+        }
+    }
+    return (-1);
+}
+
+static int GetDelta (JobReader *reader, long long *steps)
+{
+    unsigned long long value;
+
+    if (GetVarint(reader, &value) != 0)
+    {
+        return (-1);
+    }
+    *steps = Unzigzag(value);
+    return (0);
+}
+
+// Decodes one command: a record, or a raw line copied into line. Returns 1 for a record, 2 for a raw line, -1 if damaged.
+static int DecodeJobCommand (JobReader *reader, MotionRecord *record, char *line, int *length)
+{
+    unsigned char tag;
+    long long x, y, steps, i = 0, j = 0;
+
+    if (reader->end - reader->start < JOBFILE_MAX_COMMAND && !reader->atEnd)
+    {
+        FillJobReader(reader);
+    }
+    if (reader->start == reader->end)
+    {
+        return (-1);
+    }
+
+    tag = reader->buffer[reader->start++];
+    if ((tag & JOBFILE_OP_MASK) == JOBFILE_RAW)
+    {
+        unsigned long long size;
+
+        if (tag != JOBFILE_RAW || GetVarint(reader, &size) != 0 || size >= GCODE_MAX_LINE || size > reader->end - reader->start)
+        {
+            return (-1);
+        }
+        memcpy(line, &reader->buffer[reader->start], (size_t)size);
+        line[size] = '\0';
+        reader->start += (size_t)size;
+        *length = (int)size;
+        return (2);
+    }
+
+    record->op = (uint8_t)(tag & JOBFILE_OP_MASK);
+    record->x = reader->x;
+    record->y = reader->y;
+    record->i = 0;
+    record->j = 0;
+
+    if (record->op == MOTION_DWELL)
+    {
+        unsigned long long milliseconds;
+
+        if (tag != MOTION_DWELL || GetVarint(reader, &milliseconds) != 0 || milliseconds > INT16_MAX)
+        {
+            return (-1);
+        }
+        record->i = (int16_t)milliseconds;
+        return (1);
+    }
+    if (!IsMove(record->op))
+    {
+        if ((record->op != MOTION_PEN_UP && record->op != MOTION_PEN_DOWN) || tag != record->op)
+        {
+            return (-1);
+        }
+        reader->penDown = record->op == MOTION_PEN_DOWN;
+        return (1);
+    }
+
+    x = reader->x;
+    y = reader->y;
+    if (tag & JOBFILE_HAS_X)
+    {
+        if (GetDelta(reader, &steps) != 0)
+        {
+            return (-1);
+        }
+        x += steps * reader->unit;
+    }
+    if (tag & JOBFILE_HAS_Y)
+    {
+        if (GetDelta(reader, &steps) != 0)
+        {
+            return (-1);
+        }
+        y += steps * reader->unit;
+    }
+    if (IsArc(record->op) && (GetDelta(reader, &i) != 0 || GetDelta(reader, &j) != 0))
+    {
+        return (-1);
+    }
+    i *= reader->unit;
+    j *= reader->unit;
+    if ((tag & ~(JOBFILE_OP_MASK | JOBFILE_HAS_X | JOBFILE_HAS_Y)) || x != (int32_t)x || y != (int32_t)y || i != (int16_t)i || j != (int16_t)j)
+    {
+        return (-1);
+    }
+
+    record->x = reader->x = (int32_t)x;
+    record->y = reader->y = (int32_t)y;
+    record->i = (int16_t)i;
+    record->j = (int16_t)j;
+    return (1);
+}
+
+
+int OpenJobReader (JobReader *reader, const char *path)
+{
+    unsigned char header[JOBFILE_HEADER_SIZE];
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+    {
+        printf("Error: Could not open %s\n", path);
+        return (-1);
+    }
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) || memcmp(header, JOBFILE_MAGIC, 4) != 0
+        || header[4] > 3)
+    {
+        printf("Error: %s is not a job file this program can read\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return (-1);
+    }
+
+    reader->decimals = header[4];
+    reader->modal = header[5];
+    reader->unit = StepUnits[reader->decimals];
+    reader->checkpointInterval = (int)GetLittle(&header[6], 2);
+    reader->commandCount = (long)GetLittle(&header[8], 4);
+    reader->checkpointCount = (long)GetLittle(&header[12], 4);
+    reader->pageCount = (int)GetLittle(&header[16], 4);
+    reader->indexOffset = (long long)GetLittle(&header[24], 8);
+    StartEncoder(&reader->encoder, reader->modal, reader->decimals);
+    return (0);
+}
+
+int ReadJobLine (JobReader *reader, char *line)
+{
+    MotionRecord record;
+    int length = 0;
+
+    if (reader->prelude > 0)
+    {
+        // After a seek: lift the pen, go back to where the job was and put the pen back down if it was down
+        memset(&record, 0, sizeof(record));
+        record.x = reader->x;
+        record.y = reader->y;
+        record.op = reader->prelude == 3 ? MOTION_PEN_UP : reader->prelude == 2 ? MOTION_TRAVEL : MOTION_PEN_DOWN;
+        reader->prelude--;
+        if (reader->prelude == 1 && !reader->penDown)
+        {
+            reader->prelude = 0;
+        }
+        return EncodeAtPrecision(&record, reader->decimals, line);
+    }
+
+    if (reader->command >= reader->commandCount)
+    {
+        return (0);
+    }
+
+    switch (DecodeJobCommand(reader, &record, line, &length))
+    {
+        case 1:
+            length = EncodeStep(&reader->encoder, &record, line);
+            break;
+
+        case 2:
+            break;
+
+        default:
+            printf("Error: Command %ld of the job file is damaged\n", reader->command + 1);
+            return (-1);
+    }
+    reader->command++;
+    return (length);
+}
+
+
+int SeekJobCommand (JobReader *reader, long command)
+{
+    unsigned char entry[CHECKPOINT_SIZE];
+    long checkpoint;
+
+    if (command < 0 || command > reader->commandCount || reader->checkpointInterval <= 0)
+    {
+        printf("Error: The job has no command %ld\n", command);
+        return (-1);
+    }
+
+    // Start from the nearest checkpoint at or before the command and decode forward from there
+    checkpoint = command / reader->checkpointInterval;
+    if (checkpoint >= reader->checkpointCount)
+    {
+        checkpoint = reader->checkpointCount - 1;
+    }
+    if (checkpoint < 0)
+    {
+        memset(entry, 0, sizeof(entry));
+        PutLittle(entry, JOBFILE_HEADER_SIZE, 8);   // An empty job
+        checkpoint = 0;
+    }
+    else if (fseek(reader->file, (long)(reader->indexOffset + checkpoint * CHECKPOINT_SIZE), SEEK_SET) != 0
+             || fread(entry, 1, CHECKPOINT_SIZE, reader->file) != CHECKPOINT_SIZE)
+    {
+        printf("Error: The job file index is damaged\n");
+        return (-1);
+    }
+    if (fseek(reader->file, (long)GetLittle(entry, 8), SEEK_SET) != 0)
+    {
+        printf("Error: The job file index is damaged\n");
+        return (-1);
+    }
+
+    reader->start = reader->end = 0;
+    reader->atEnd = 0;
+    reader->x = (int32_t)GetLittle(&entry[8], 4);
+    reader->y = (int32_t)GetLittle(&entry[12], 4);
+    reader->penDown = entry[16];
+    reader->command = checkpoint * reader->checkpointInterval;
+
+    while (reader->command < command)
+    {
+        MotionRecord record;
+        char skipped[GCODE_MAX_LINE];
+        int length;
+
+        if (DecodeJobCommand(reader, &record, skipped, &length) < 0)
+        {
+            printf("Error: Command %ld of the job file is damaged\n", reader->command + 1);
+            return (-1);
+        }
+        reader->command++;
+    }
+
+    // The robot is in an unknown state, so the next line is sent in full
+    StartEncoder(&reader->encoder, reader->modal, reader->decimals);
+    reader->prelude = command > 0 ? 3 : 0;
+    return (0);
+}
+
+int SeekJobPage (JobReader *reader, int page)
+{
+    unsigned char entry[4];
+
+    if (page < 0 || page >= reader->pageCount)
+    {
+        printf("Error: The job has %d pages, there is no page %d\n", reader->pageCount, page + 1);
+        return (-1);
+    }
+    if (fseek(reader->file, (long)(reader->indexOffset + reader->checkpointCount * CHECKPOINT_SIZE + page * 4), SEEK_SET) != 0
+        || fread(entry, 1, sizeof(entry), reader->file) != sizeof(entry))
+    {
+        printf("Error: The job file index is damaged\n");
+        return (-1);
+    }
+    return SeekJobCommand(reader, (long)GetLittle(entry, 4));
+}
+
+void CloseJobReader (JobReader *reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+
+//// Converters ////
+
+int ConvertGCodeToJob (const char *gcodePath, const char *jobPath, int modal, int decimals)
+{
+    GCodeReader reader;
+    JobWriter writer;
+    char line[GCODE_MAX_LINE];
+    int length, failed;
+
+    if (OpenGCodeReader(&reader, gcodePath) != 0)
+    {
+        return (-1);
+    }
+    if (OpenJobWriter(&writer, jobPath, modal, decimals) != 0)
+    {
+        CloseGCodeReader(&reader);
+        return (-1);
+    }
+
+    while ((length = ReadGCodeLine(&reader, line)) > 0)
+    {
+        WriteJobCommand(&writer, line, (size_t)length);
+    }
+
+    failed = CloseJobWriter(&writer) != 0 || length < 0;
+    CloseGCodeReader(&reader);
+    return failed ? -1 : 0;
+}
+
+int ConvertJobToGCode (const char *jobPath, const char *gcodePath)
+{
+    JobReader *reader = malloc(sizeof(JobReader));      // Too large for some stacks; the decoding itself allocates nothing
+    GCodeWriter writer;
+    char line[GCODE_MAX_LINE];
+    int length, failed;
+
+    if (!reader)
+    {
+        printf("Error: Unable to allocate memory for the job file.\n");
+        return (-1);
+    }
+    if (OpenJobReader(reader, jobPath) != 0)
+    {
+        free(reader);
+        return (-1);
+    }
+    if (OpenGCodeWriter(&writer, gcodePath) != 0)
+    {
+        CloseJobReader(reader);
+        free(reader);
+        return (-1);
+    }
+
+    while ((length = ReadJobLine(reader, line)) > 0)
+    {
+        WriteGCode(&writer, line, (size_t)length);
+    }
+
+    failed = CloseGCodeWriter(&writer) != 0 || length < 0;
+    CloseJobReader(reader);
+    free(reader);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+
+#include "encoder.h"
+#include "gcodefile.h"
+
+
+#ifndef JOBFILE_H_INCLUDED
+#define JOBFILE_H_INCLUDED
+
+
+#define JOBFILE_MAGIC           "RWJ\x02"       /* First four bytes of every job file, the last one is the format version */
+#define JOBFILE_HEADER_SIZE     32              /* Bytes before the first command */
+#define JOBFILE_CHECKPOINT      256             /* Commands between seek index entries */
+#define JOBFILE_PAGE_HEIGHT     270.0           /* mm of writing per page, the same as PLANNER_PAGE_HEIGHT */
+#define JOBFILE_MAX_PAGES       1024            /* Pages the index can point at */
+#define JOBFILE_BUFFER          (64 * 1024)     /* Bytes each reader and writer gathers before touching the disk */
+#define JOBFILE_MAX_COMMAND     (8 + GCODE_MAX_LINE) /* Longest encoded command: a tag, a length and a raw line */
+
+// Each command is a tag byte followed by its payload. The low four bits of the tag are the motion op, or
+// JOBFILE_RAW for a line stored as text. Pen changes carry no payload and dwells a varint of milliseconds.
+// Moves store X and Y as zigzag varint deltas from the previous move, in units of the last printed decimal,
+// and only for axes that changed; arcs add I and J the same way, but absolute.
+#define JOBFILE_OP_MASK         0x0F            /* Tag bits holding the op */
+#define JOBFILE_RAW             0x0F            /* Tag for a line kept verbatim: a varint length and the text */
+#define JOBFILE_HAS_X           0x10            /* Tag bit: an X delta follows */
+#define JOBFILE_HAS_Y           0x20            /* Tag bit: a Y delta follows */
+
+typedef struct
+{
+    long long offset;                           // Where the command starts in the file
+    int32_t x, y;                               // Pen position before it, micrometres
+    int penDown;                                // Pen state before it
+} JobCheckpoint;                                // Enough to start decoding in the middle of a job
+
+typedef struct
+{
+    FILE *file;
+    unsigned char *buffer;                      // Bytes waiting to be written
+    size_t used;
+    long long bytes;                            // Bytes written in total, header included
+    long long textBytes;                        // Bytes of G-code that went in
+    GCodeEncoder encoder;                       // Reproduces the text from each record, to prove it round-trips
+    int unit;                                   // Micrometres per stored step, 10^(3 - decimals)
+    int32_t x, y;                               // Position after the last move record
+    int penDown;
+    int motionMode;                             // G0 to G3 last parsed, for modal lines that leave it out
+    long commands;                              // Commands written
+    long raw;                                   // Of those, lines kept as text
+    JobCheckpoint *checkpoints;
+    long checkpointCount, checkpointCapacity;
+    long pages[JOBFILE_MAX_PAGES];              // First command on each page
+    int pageCount;
+    int failed;                                 // Set once a write has failed; later writes are skipped
+} JobWriter;                                    // A .rwj job file being written
+
+typedef struct
+{
+    FILE *file;
+    unsigned char buffer[JOBFILE_BUFFER];       // Held in the reader itself, so decoding never allocates
+    size_t start, end;                          // Unread part of buffer
+    int atEnd;
+    GCodeEncoder encoder;                       // Turns each record back into the line it came from
+    int decimals, modal, unit;
+    int32_t x, y;
+    int penDown;
+    long command;                               // Next command to decode
+    long commandCount, checkpointCount;
+    int checkpointInterval, pageCount;
+    long long indexOffset;                      // Where the checkpoints and page table start
+    int prelude;                                // Lines of the resume prelude still to hand out after a seek
+} JobReader;                                    // A .rwj job file being replayed
+
+// Creates a job file for lines that an encoder with these settings produces. Lines it produces are stored
+// as records; anything else (the preamble, comments, hand-written G-code) is kept as text, so the file always
+// converts back to exactly the lines that went in. Lines kept as text do not move the tracked pen position,
+// which only matters if one of them is a move and a reader later seeks past it. Returns -1 if the file cannot be created.
+int OpenJobWriter (JobWriter *writer, const char *path, int modal, int decimals);
+void WriteJobCommand (JobWriter *writer, const char *text, size_t length);
+int CloseJobWriter (JobWriter *writer);         // Writes the index, prints size and returns -1 if anything failed to write
+
+int OpenJobReader (JobReader *reader, const char *path);                      // Returns -1 if the file is not a job file
+
+// Decodes the next command into line as "...\n", NUL terminated, and returns its length, 0 at the end of the
+// job or -1 if the file is damaged. The line is at most GCODE_MAX_LINE bytes.
+int ReadJobLine (JobReader *reader, char *line);
+
+// Jump to a command, counting from 0, or to the first command on a page. The next few lines read are then a
+// prelude that lifts the pen, travels to where the job was and puts the pen back down if it was down.
+// Returns -1 if the command or page is not in the job.
+int SeekJobCommand (JobReader *reader, long command);
+int SeekJobPage (JobReader *reader, int page);
+void CloseJobReader (JobReader *reader);
+
+// Converters in both directions; return -1 on failure
+int ConvertGCodeToJob (const char *gcodePath, const char *jobPath, int modal, int decimals);
+int ConvertJobToGCode (const char *jobPath, const char *gcodePath);
+
+#endif // JOBFILE_H_INCLUDED
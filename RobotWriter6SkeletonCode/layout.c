@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+#include "linebreak.h"
+
+
+static int FontHasCharacter (const TextLayout *layout, int asciiCode)
+{
+    int k;
+
+    for (k = 0; k < layout->characterCount; k++)
+    {
+        if (layout->fontArray[k].asciiCode == asciiCode)
+        {
+            return (1);
+        }
+    }
+    return (0);
+}
+
+// Draws one word, or nothing at all if memory runs out part way through it
+static int DrawWholeWord (TextLayout *layout, const char *word, double xPos, MotionBuffer *motion)
+{
+    size_t before = motion->count;
+
+    if (DrawGlyphWord(&layout->glyphs, word, xPos, layout->yPos, motion) != 0)
+    {
+        motion->count = before;
+        return (-1);
+    }
+    return (0);
+}
+
+static int StartLine (TextLayout *layout, MotionBuffer *motion)
+{
+    layout->yPos -= LAYOUT_LINE_PITCH_MM;
+    return AppendMotion(motion, MOTION_LINE, 0, MotionFromMM(layout->yPos));
+}
+
+// Keeps the word until the whole paragraph is known
+static int BufferWord (TextLayout *layout, double width)
+{
+    if (layout->paragraphCount == layout->paragraphCapacity) // Grow the paragraph buffers when they are full
+    {
+        int newCapacity = layout->paragraphCapacity ? layout->paragraphCapacity * 2 : 64;
+        char (*newWords)[LAYOUT_MAX_WORD] = realloc(layout->paragraphWords, (size_t)newCapacity * sizeof(*layout->paragraphWords));
+        double *newWidths = newWords ? realloc(layout->paragraphWidths, (size_t)newCapacity * sizeof(double)) : NULL;
+        int *newEnds = newWidths ? realloc(layout->lineEnds, (size_t)newCapacity * sizeof(int)) : NULL;
+
+        if (newWords) layout->paragraphWords = newWords;
+        if (newWidths) layout->paragraphWidths = newWidths;
+        if (!newEnds)
+        {
+            printf("Error: Unable to allocate memory for paragraph layout.\n");
+            return (-1);
+        }
+        layout->lineEnds = newEnds;
+        layout->paragraphCapacity = newCapacity;
+    }
+
+    strcpy(layout->paragraphWords[layout->paragraphCount], layout->word);
+    layout->paragraphWidths[layout->paragraphCount] = width;
+    layout->paragraphCount++;
+    return (0);
+}
+
+// Lays out the buffered words of a paragraph with the line breaker and draws them, leaving yPos on its last line
+static int FlushParagraph (TextLayout *layout, MotionBuffer *motion)
+{
+    const double *widths = layout->paragraphWidths;
+    int wordCount = layout->paragraphCount;
+    int lineCount, line, first = 0, i;
+
+    layout->paragraphCount = 0;
+    if (wordCount == 0)
+    {
+        return (0);
+    }
+
+    lineCount = ComputeOptimalLineBreaks(widths, wordCount, LAYOUT_LINE_WIDTH_MM, layout->lineEnds);
+    if (lineCount < 0) // No memory for the line breaker: wrap this paragraph greedily instead
+    {
+        double width = 0;
+
+        printf("Warning: Unable to allocate memory for optimal line breaks, wrapping the paragraph greedily.\n");
+        lineCount = 0;
+        for (i = 0; i < wordCount; i++)
+        {
+            if (width > 0 && width + widths[i] > LAYOUT_LINE_WIDTH_MM)
+            {
+                layout->lineEnds[lineCount++] = i;
+                width = 0;
+            }
+            width += widths[i];
+        }
+        layout->lineEnds[lineCount++] = wordCount;
+    }
+
+    for (line = 0; line < lineCount; line++)
+    {
+        double xPos = 0;
+
+        if (line > 0 && StartLine(layout, motion) != 0) // Move down for each line after the first
+        {
+            return (-1);
+        }
+        for (i = first; i < layout->lineEnds[line]; i++)
+        {
+            if (DrawWholeWord(layout, layout->paragraphWords[i], xPos, motion) != 0)
+            {
+                return (-1);
+            }
+            xPos += widths[i];
+        }
+        first = layout->lineEnds[line];
+    }
+    return (0);
+}
+
+// Reads the word starting at position, splitting it like %99s would, and checks the font can draw all of it
+static int ReadWord (TextLayout *layout)
+{
+    const char *text = layout->text;
+    size_t length = 0;
+    int supported = 1;
+    int k;
+
+    while (length < LAYOUT_MAX_WORD - 1 && (unsigned char)text[layout->position + length] > 32)
+    {
+        layout->word[length] = text[layout->position + length];
+        length++;
+    }
+    layout->word[length] = '\0';
+    layout->position += length;
+
+    for (k = 0; layout->word[k] != '\0' && supported; k++)
+    {
+        if (!FontHasCharacter(layout, layout->word[k]))
+        {
+            printf("Error: Character '%c' is not supported by the loaded font.\n", layout->word[k]);
+            supported = 0;
+        }
+    }
+    return supported ? 0 : -1;
+}
+
+
+void StartTextLayout (TextLayout *layout, const char *text, FontCharacter *fontArray, int characterCount, double scaleFactor, int optimalBreaks)
+{
+    memset(layout, 0, sizeof(*layout));
+    layout->text = text;
+    layout->state = LAYOUT_SEEKING_WORD;
+    layout->optimalBreaks = optimalBreaks;
+    layout->fontArray = fontArray;
+    layout->characterCount = characterCount;
+    StartGlyphCache(&layout->glyphs, fontArray, characterCount, scaleFactor);
+}
+
+LayoutEvent AdvanceLayout (TextLayout *layout, MotionBuffer *motion)
+{
+    if (!layout->marked)
+    {
+        // Mark the first line so optimizers can find the line boundaries
+        if (AppendMotion(motion, MOTION_LINE, 0, MotionFromMM(layout->yPos)) != 0)
+        {
+            layout->state = LAYOUT_FINISHED;
+            return LAYOUT_ERROR;
+        }
+        layout->marked = 1;
+    }
+
+    for (;;)
+    {
+        switch (layout->state)
+        {
+            case LAYOUT_SEEKING_WORD:
+            {
+                unsigned char ch = (unsigned char)layout->text[layout->position];
+
+                if (ch == '\0' || ch == '\n')
+                {
+                    if (layout->optimalBreaks && FlushParagraph(layout, motion) != 0)
+                    {
+                        layout->state = LAYOUT_FINISHED;
+                        return LAYOUT_ERROR;
+                    }
+                    if (ch == '\0')
+                    {
+                        layout->state = LAYOUT_FINISHED;
+                        return LAYOUT_END;
+                    }
+                    layout->position++;
+                    layout->xPos = 0; // Reset X position for the new line
+                    if (StartLine(layout, motion) != 0)
+                    {
+                        layout->state = LAYOUT_FINISHED;
+                        return LAYOUT_ERROR;
+                    }
+                    return LAYOUT_NEWLINE;
+                }
+                if (ch <= 32) // Skip non-printable characters and spaces
+                {
+                    layout->position++;
+                    break;
+                }
+
+                if (ReadWord(layout) != 0)
+                {
+                    layout->state = LAYOUT_FINISHED;
+                    return LAYOUT_ERROR;
+                }
+                layout->state = LAYOUT_PROCESSING_WORD;
+                return LAYOUT_WORD;
+            }
+
+            case LAYOUT_PROCESSING_WORD:
+            {
+                double width = LayoutWordWidth(layout, layout->word);
+
+                layout->state = LAYOUT_SEEKING_WORD;
+                if (layout->optimalBreaks)
+                {
+                    if (BufferWord(layout, width) != 0)
+                    {
+                        layout->state = LAYOUT_FINISHED;
+                        return LAYOUT_ERROR;
+                    }
+                    break;
+                }
+
+                if (layout->xPos > 0 && layout->xPos + width > LAYOUT_LINE_WIDTH_MM) // Check if the word exceeds the line width
+                {
+                    layout->xPos = 0;
+                    if (StartLine(layout, motion) != 0)
+                    {
+                        layout->state = LAYOUT_FINISHED;
+                        return LAYOUT_ERROR;
+                    }
+                }
+                if (DrawWholeWord(layout, layout->word, layout->xPos, motion) != 0)
+                {
+                    layout->state = LAYOUT_FINISHED;
+                    return LAYOUT_ERROR;
+                }
+                layout->xPos += width; // Move past the word and the space after it
+                break;
+            }
+
+            default:
+                return LAYOUT_END;
+        }
+    }
+}
+
+double LayoutWordWidth (const TextLayout *layout, const char *word)
+{
+    double width = 0.0;
+    int k;
+
+    for (k = 0; word[k] != '\0'; k++)
+    {
+        if (FontHasCharacter(layout, word[k]))
+        {
+            width += 15.0 * layout->glyphs.scaleFactor;
+        }
+    }
+    return width + 5.0 * layout->glyphs.scaleFactor;
+}
+
+void FreeTextLayout (TextLayout *layout)
+{
+    free(layout->paragraphWords);
+    free(layout->paragraphWidths);
+    free(layout->lineEnds);
+    layout->paragraphWords = NULL;
+    layout->paragraphWidths = NULL;
+    layout->lineEnds = NULL;
+    FreeGlyphCache(&layout->glyphs);
+}
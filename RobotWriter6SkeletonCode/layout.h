@@ -0,0 +1,64 @@
+#include <stdio.h>
+
+#include "font.h"
+#include "motion.h"
+#include "glyph.h"
+
+
+#ifndef LAYOUT_H_INCLUDED
+#define LAYOUT_H_INCLUDED
+
+
+#define LAYOUT_MAX_WORD         100             /* Longest word, including the terminator; longer ones are split like %99s does */
+#define LAYOUT_LINE_WIDTH_MM    100.0           /* Widest a line of text may be */
+#define LAYOUT_LINE_SPACING_MM  5.0             /* Gap between lines of text */
+#define LAYOUT_LINE_PITCH_MM    (LAYOUT_LINE_SPACING_MM + 10.0) /* Baseline to baseline: the spacing plus a line's own 10 mm */
+
+typedef enum
+{
+    LAYOUT_SEEKING_WORD,                        // Skipping spaces and newlines up to the next word
+    LAYOUT_PROCESSING_WORD,                     // A word has been read and is waiting to be placed
+    LAYOUT_FINISHED                             // The text has run out and everything in it has been drawn
+} LayoutState;
+
+typedef enum
+{
+    LAYOUT_WORD,                                // A word has been read, it is in word
+    LAYOUT_NEWLINE,                             // The text started a new line, which is at yPos
+    LAYOUT_END,                                 // The text has run out
+    LAYOUT_ERROR                                // A character the font cannot draw, or out of memory; nothing more is drawn
+} LayoutEvent;
+
+typedef struct
+{
+    const char *text;                           // Text being laid out, owned by the caller
+    size_t position;                            // Next character to read
+    LayoutState state;
+    int optimalBreaks;                          // 1 to lay out each paragraph with the line breaker instead of greedy wrapping
+    int marked;                                 // Set once the first line has been marked
+    char word[LAYOUT_MAX_WORD];                 // Word read last
+    double xPos, yPos;                          // Where the next word goes, mm; xPos is only used by greedy wrapping
+    FontCharacter *fontArray;
+    int characterCount;
+    GlyphCache glyphs;                          // Each character is scaled and simplified once, then reused every time it is drawn
+    char (*paragraphWords)[LAYOUT_MAX_WORD];    // Words of the current paragraph, laid out together when the paragraph ends
+    double *paragraphWidths;                    // Width of each buffered word
+    int *lineEnds;                              // Line breaks chosen by the line breaker
+    int paragraphCount;                         // Number of buffered words
+    int paragraphCapacity;                      // Number of words the buffers can hold
+} TextLayout;                                   // Places the words of a text on the page, for the batch layout and the pull generator alike
+
+void StartTextLayout (TextLayout *layout, const char *text, FontCharacter *fontArray, int characterCount, double scaleFactor, int optimalBreaks);
+
+// Runs the layout on to its next event, appending the moves of whatever it places to motion, with a MOTION_LINE
+// marker at the start of every line. Greedy wrapping draws each word as soon as it has been read; the line
+// breaker holds a paragraph back until its newline, or the end of the text, and then draws all of it.
+// Only whole words are ever appended, and nothing once LAYOUT_ERROR has been returned.
+LayoutEvent AdvanceLayout (TextLayout *layout, MotionBuffer *motion);
+
+// Same measure as the drawing: a fixed advance per character the font has, plus the space after the word
+double LayoutWordWidth (const TextLayout *layout, const char *word);
+
+void FreeTextLayout (TextLayout *layout);
+
+#endif // LAYOUT_H_INCLUDED
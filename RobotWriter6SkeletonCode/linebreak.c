@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "linebreak.h"
+
+
+// Minimum-cost line breaking over a paragraph.
+// best[j] is the cheapest way to lay out the first j words and lineStart[j] is where its last line begins.
+// A line is only ever extended while it still fits, so the inner loop runs at most (words per line) times
+// and the whole pass is linear in the number of words rather than quadratic.
+int ComputeOptimalLineBreaks (const double *wordWidths, int wordCount, double lineWidth, int *lineEnds)
+{
+    double *best;
+    int *lineStart;
+    int i, j, lineCount;
+
+    if (wordCount <= 0)
+    {
+        return (0);
+    }
+
+    best = malloc((size_t)(wordCount + 1) * sizeof(double));
+    lineStart = malloc((size_t)(wordCount + 1) * sizeof(int));
+    if (!best || !lineStart)
+    {
+        printf("Error: Unable to allocate memory for line breaking.\n");
+        free(best);
+        free(lineStart);
+        return (-1);
+    }
+
+    best[0] = 0.0;
+    for (j = 1; j <= wordCount; j++)
+    {
+        best[j] = -1.0;     // Not reached yet
+    }
+
+    for (i = 0; i < wordCount; i++)
+    {
+        double lineLength = 0.0;
+
+        for (j = i; j < wordCount; j++)
+        {
+            double cost;
+
+            lineLength += wordWidths[j];
+
+            // A word wider than the page still gets a line of its own
+            if (lineLength > lineWidth && j > i)
+            {
+                break;
+            }
+
+            cost = best[i] + LINE_BREAK_LINE_COST;
+            if (j + 1 < wordCount && lineLength < lineWidth)
+            {
+                double slack = lineWidth - lineLength;      // The last line is allowed to be short
+                cost += LINE_BREAK_RAGGED_WEIGHT * slack * slack;
+            }
+
+            if (best[j + 1] < 0.0 || cost < best[j + 1])
+            {
+                best[j + 1] = cost;
+                lineStart[j + 1] = i;
+            }
+        }
+    }
+
+    // Walk back from the end, then reverse so the breaks come out in reading order
+    lineCount = 0;
+    for (j = wordCount; j > 0; j = lineStart[j])
+    {
+        lineEnds[lineCount++] = j;
+    }
+    for (i = 0; i < lineCount / 2; i++)
+    {
+        int swap = lineEnds[i];
+        lineEnds[i] = lineEnds[lineCount - 1 - i];
+        lineEnds[lineCount - 1 - i] = swap;
+    }
+
+    free(best);
+    free(lineStart);
+
+    return (lineCount);
+}
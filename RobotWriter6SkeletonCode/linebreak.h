@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+
+#ifndef LINEBREAK_H_INCLUDED
+#define LINEBREAK_H_INCLUDED
+
+
+#define LINE_BREAK_LINE_COST    400.0           /* Cost of one extra line (carriage return + line feed), in mm^2 */
+#define LINE_BREAK_RAGGED_WEIGHT 1.0            /* Weight applied to the squared unused width of each line */
+
+// Computes cost-minimising line breaks for one paragraph of pre-measured words.
+// wordWidths[i] includes the trailing word space, the same way LayoutWordWidth() measures it.
+// On success lineEnds[k] holds the index one past the last word of line k and the number of lines is returned.
+// lineEnds must have room for wordCount entries. Returns -1 if memory could not be allocated.
+int ComputeOptimalLineBreaks (const double *wordWidths, int wordCount, double lineWidth, int *lineEnds);
+
+#endif // LINEBREAK_H_INCLUDED
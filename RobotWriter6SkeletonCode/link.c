@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+#include "link.h"
+#include "serial.h"
+
+
+static int SendToRobot (void *context, const char *bytes, size_t length)
+{
+    (void)context;
+    return SendBytes(bytes, (int)length);
+}
+
+static int ReceiveFromRobot (void *context, char *reply, int size, int timeoutMs)
+{
+    (void)context;
+    return ReadReply(reply, size, timeoutMs);
+}
+
+SerialLink RobotLink (void)
+{
+    SerialLink link = { "robot", SendToRobot, ReceiveFromRobot, NULL };
+    return link;
+}
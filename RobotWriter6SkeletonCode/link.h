@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+
+#ifndef LINK_H_INCLUDED
+#define LINK_H_INCLUDED
+
+
+#define LINK_MAX_REPLY          96              /* Longest reply line kept, including the terminator; longer ones are cut short */
+#define LINK_REPLY_TOO_LONG     (-2)            /* From receive: a line ran past the link's own buffer and was thrown away */
+
+typedef struct
+{
+    const char *name;                           // Shown in error messages
+    int (*send) (void *context, const char *bytes, size_t length);              // Returns -1 if the bytes could not be sent
+    int (*receive) (void *context, char *reply, int size, int timeoutMs);       // Next reply line, without its line ending
+    void *context;                              // Passed back to send and receive
+} SerialLink;                                   // A byte stream to a controller and the lines it answers with
+
+// receive copies the next reply into reply, NUL terminated and cut to size, and returns its length.
+// It returns 0 if nothing complete arrived within timeoutMs and -1 if the link failed; blank lines are skipped.
+// LINK_REPLY_TOO_LONG means a line was too long to hold at all; the link still works and the next line is read as usual.
+
+SerialLink RobotLink (void);                    // The robot on the COM port set in serial.h
+
+#endif // LINK_H_INCLUDED
@@ -1,28 +1,119 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "rs232.h"
-//#include "serial.h"
+#include "serial.h"
+#include "font.h"
+#include "glyph.h"
+#include "layout.h"
+#include "motion.h"
+#include "encoder.h"
+#include "pen.h"
+#include "peephole.h"
+#include "reorder.h"
+#include "pageorder.h"
+#include "anytime.h"
+#include "imposition.h"
+#include "grid.h"
+#include "planner.h"
+#include "gcodefile.h"
+#include "jobfile.h"
+#include "job.h"
+#include "sink.h"
+#include "bounds.h"
+#include "settle.h"
+#include "link.h"
+#include "numbered.h"
+#include "stream.h"
+#include "bench.h"
 
 #define baud_rate 115200 //The baud rate for serial communication
-#define MAX_ASCII 128 //Maximum number of ASCII characters supported
-#define LINE_SPACING_MM 5.0 //Line spacing in mm for text output
-#define MAX_LINE_WIDTH_MM 100.0 //Maximum line width in mm for text output
-#define FONT_MARKER 999 //Marker used to identify font data in the input file
+
+//#define OPTIMAL_LINE_BREAKS //Uncomment to lay out each paragraph with the cost-minimising line breaker instead of greedy wrapping
+//#define IMPOSITION_MODE //Uncomment to lay the text out once and draw it on a grid of copies (see imposition.h)
+//#define REORDER_STROKES //Uncomment to reorder the strokes of each line to cut pen up travel (see reorder.h)
+//#define REORDER_PAGE //Uncomment to reorder every stroke of the job at once, across lines (see pageorder.h)
+//#define REORDER_ANYTIME //Uncomment to start drawing at once and reorder the lines still to come in the background (see anytime.h)
+//#define MODAL_GCODE //Uncomment to leave out G words and coordinates the robot already has (see encoder.h)
+//#define MACHINE_GRID //Uncomment to snap every point to the robot's step grid and print only the decimals that needs (see grid.h)
+//#define EXPORT_GCODE "RobotTesting.gcode" //Uncomment to write the program to this file instead of sending it (see gcodefile.h)
+//#define REPLAY_GCODE "RobotTesting.gcode" //Uncomment to send this previously exported file instead of laying out text
+//#define EXPORT_JOB "RobotTesting.rwj" //Uncomment to write the program to this compact job file instead of sending it (see jobfile.h)
+//#define REPLAY_JOB "RobotTesting.rwj" //Uncomment to send this previously exported job file instead of laying out text
+//#define REPLAY_FROM_PAGE 2 //Uncomment to start a replayed job file at this page, counting from 1
+//#define PULL_GENERATOR //Uncomment to lay out, optimize and encode the text one command at a time as the robot asks for it (see job.h)
+//#define FIT_TO_LIMITS //Uncomment to shrink a job that would leave the work area instead of refusing to send it (see bounds.h)
+//#define MIRROR_GCODE "RobotMirror.gcode" //Uncomment to keep a copy of everything sent to the robot in this file
+//#define PREVIEW_JOB //Uncomment to print a text drawing of the job once it has been sent (see sink.h)
+//#define SINK_STATS //Uncomment to count the commands and bytes that went out
+//#define NUMBERED_LINES //Uncomment to send Marlin-style line numbers and checksums and resend damaged lines (see numbered.h)
+//#define STREAM_LINES 128 //Uncomment to keep GRBL's receive buffer of this many bytes full instead of waiting for each ok (see stream.h)
+//#define CALIBRATE_PEN_SETTLE //Uncomment to draw the pen settle calibration card and save the dwell picked from it (see settle.h)
+//#define ESTIMATE_TIME //Uncomment to print how long the robot will take before anything is sent (see planner.h)
+//#define RUN_BENCHMARKS //Uncomment to time the encoder, planner, bounds check, export, job files, serial link and streaming on a synthetic document instead of drawing (see bench.h)
+
+#ifdef PULL_GENERATOR
+// The generator only ever holds one word, or one paragraph with optimal line breaks, so anything that needs the whole job cannot run
+#if defined(REORDER_STROKES) || defined(REORDER_PAGE) || defined(REORDER_ANYTIME)
+#error "PULL_GENERATOR cannot reorder strokes, it never holds a whole line; turn the REORDER toggles off"
+#endif
+#ifdef FIT_TO_LIMITS
+#error "PULL_GENERATOR cannot shrink a job it has not finished laying out; turn FIT_TO_LIMITS off"
+#endif
+#ifdef IMPOSITION_MODE
+#error "PULL_GENERATOR cannot stamp copies of a job it never holds whole; turn IMPOSITION_MODE off"
+#endif
+#ifdef ESTIMATE_TIME
+#error "PULL_GENERATOR cannot time a job before it has been laid out; turn ESTIMATE_TIME off"
+#endif
+#endif
 
 typedef struct
 {
-    int asciiCode; //ascii code of the character
-    int strokeTotal; //Number of strokes required to draw the character
-    int (*strokeData)[3]; //Pointer to the stroke data, where each stroke has three components
-} FontCharacter; //structure to hold character data
+    PenTracker pen; // Pen state, so S0/S1000 are only sent when the pen actually has to move
+    Peephole peephole; // Drops redundant steps before they cost a round trip to the robot
+    GCodeEncoder encoder; // What the robot already knows, so it is not sent again
+    const SinkList *sinks; // Where the G-code goes: the robot, a file, a preview...
+    int settleMs; // Dwell the robot adds after each pen change, from the calibration (see settle.h)
+} SendState; // Everything between the laid-out job and the robot
 
-void SendCommands(char *buffer); //Function to send G-code commnds to the robot
 double promptTextHeight(); //Function to prompt the user for text height input
 double computeScaleFactor(double textHeight); //Function to calculate the scale factor for text height
-FontCharacter* loadFont(const char *filename, int *characterCount); //Function to load font data from a file into memory
-void convertTextToGCode(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor); //Function to process the text file and generate G-code
-void printGCodeLine(char *buffer); //Function to print G code commands to the terminal
-double calculateWordWidth(const char* word, FontCharacter *fontArray, int characterCount, double scaleFactor) 
+void convertTextToGCode(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, MotionBuffer *motion); //Function to process the text file and generate G-code
+void imposeTextOnGrid(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, const SinkList *sinks); //Function to lay out the text once and draw copies of it on a grid
+void drawText(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, const SinkList *sinks); //Function to lay out, optimize and send the text
+#ifdef PULL_GENERATOR
+void streamText(const char *filename, FontCharacter *fontArray, int characterCount, double textHeight, const SinkList *sinks); //Function to generate and send the text one command at a time
+#endif
+char *readTextFile(const char *filename); //Function to read the whole text file into a string
+void sendPreamble(const SinkList *sinks); //Function to send the commands that get the robot ready to draw
+#if defined(EXPORT_GCODE) || defined(EXPORT_JOB)
+int exportProgram(const char *filename, FontCharacter *fontArray, int characterCount, double textHeight); //Function to write the whole program to a .gcode file, a job file or both
+#endif
+#ifdef REPLAY_GCODE
+void replayGCodeFile(const char *path, const SinkList *sinks); //Function to stream an existing .gcode file to the robot
+#endif
+#ifdef REPLAY_JOB
+void replayJobFile(const char *path, const SinkList *sinks); //Function to decode a job file and stream it to the robot
+#endif
+#ifdef EXPORT_JOB
+void jobFileSettings(int *modal, int *decimals); //Function to work out how the encoder will print the job, so the job file can store it as records
+#endif
+int snapToMachineGrid(MotionBuffer *motion); //Function to snap the job to the robot's step grid, returning the decimals to print
+int preflightJob(MotionBuffer *motion); //Function to check the whole job against the soft limits before anything is sent
+void estimateTime(const MotionBuffer *motion); //Function to print how long the robot will take to draw the job
+void sendMotion(const MotionBuffer *motion, int decimals, const SinkList *sinks); //Function to encode the laid-out job as G-code and send it
+#ifdef REORDER_ANYTIME
+void sendMotionAnytime(const MotionBuffer *motion, int decimals, const SinkList *sinks); //Function to send the job while the lines still to come are reordered in the background
+#endif
+void startSending(SendState *state, int decimals, const SinkList *sinks); //Function to reset the sending stages before a job
+void sendStep(const MotionRecord *record, SendState *state); //Function to pass one step through pen tracking and the peephole optimizer
+void finishSending(SendState *state); //Function to flush the last steps of a job and print the sending stats
+void sendRecord(const MotionRecord *record, SendState *state); //Function to encode one step as G-code and send it
+#ifdef CALIBRATE_PEN_SETTLE
+void calibratePenSettle(const SinkList *sinks); //Function to draw the pen settle calibration card and save the settle time picked from it
+#endif
+void attachOptionalSinks(SinkList *sinks, Preview *preview, SinkStats *stats); //Function to attach the preview and stats sinks when they are turned on
 
 int main()
 {
@@ -31,6 +122,18 @@ int main()
     double textHeight, scaleFactor; //Define text height and scalefactor
     int characterCount=0; 
 
+#ifdef RUN_BENCHMARKS
+    RunEncoderBenchmark();
+    RunPlannerBenchmark();
+    RunBoundsBenchmark();
+    RunExportBenchmark();
+    RunJobFileBenchmark();
+    RunLinkBenchmark();
+    RunStreamBenchmark();
+    return (0);
+#endif
+
+#if !defined(REPLAY_GCODE) && !defined(REPLAY_JOB) && !defined(CALIBRATE_PEN_SETTLE)
     //Load font data into memory
     FontCharacter *fontArray=loadFont(fontFilePath, &characterCount);
     if (!fontArray)
@@ -39,9 +142,6 @@ int main()
     }
     printf("Loaded %d characters from font file. \n", characterCount);
     
-    //char mode[]= {'8','N','1',0};
-    char buffer[100];
-
     //Calls TextHeight function
     textHeight=promptTextHeight(); 
 
@@ -49,6 +149,27 @@ int main()
     scaleFactor=computeScaleFactor(textHeight); 
     printf("Calculated scale factor: %.4f\n", scaleFactor);
 
+#if defined(EXPORT_GCODE) || defined(EXPORT_JOB)
+    //Write the program to a file, nothing is sent to the robot
+    return exportProgram(inputTextPath, fontArray, characterCount, textHeight);
+#endif
+#else
+    (void)fontFilePath;
+    (void)inputTextPath;
+    (void)textHeight;
+    (void)scaleFactor;
+    (void)characterCount;
+#endif
+
+    //char mode[]= {'8','N','1',0};
+    char buffer[100];
+    SinkList sinks; // Everywhere the commands go, each gets every command once
+    Preview preview;
+    SinkStats stats;
+#ifdef MIRROR_GCODE
+    GCodeWriter mirror; // Copy of everything sent to the robot
+#endif
+
     // If we cannot open the port then give up immediately
     if ( CanRS232PortBeOpened() == -1 )
     {
@@ -63,23 +184,64 @@ int main()
     sprintf (buffer, "\n");
      // printf ("Buffer to send: %s", buffer); // For diagnostic purposes only, normally comment out
     PrintBuffer (&buffer[0]);
-    Sleep(100);
 
-    // This is a special case - we wait  until we see a dollar ($)
-    WaitForDollar();
+    // This is a special case - we wait  until we see a dollar ($), however long the robot takes to reset, up to wake_timeout_ms
+    if ( WaitForDollar() != 0 )
+    {
+        CloseRS232Port();
+        exit (0);
+    }
 
     printf ("\nThe robot is now ready to draw\n");
 
-    //These commands get the robot into 'ready to draw mode' and need to be sent before any writing commands
-    sprintf (buffer, "G1 X0 Y0 F1000\n");
-    SendCommands(buffer);
-    sprintf (buffer, "M3\n");
-    SendCommands(buffer);
-    sprintf (buffer, "S0\n");
-    SendCommands(buffer);
-
-    //Call processTextFileTest function
-    convertTextToGCode(inputTextPath, fontArray, characterCount, scaleFactor);
+    StartSinks(&sinks);
+    AttachSink(&sinks, TerminalSink()); // Print the G-code line for debugging
+#ifdef NUMBERED_LINES
+    NumberedSender numbered; // Numbers, checksums and the lines kept for resending
+    if (StartNumbered(&numbered, RobotLink()) != 0)
+    {
+        CloseRS232Port();
+        return 1;
+    }
+    AttachSink(&sinks, NumberedSink(&numbered)); // Send the command to the robot, again if it arrives damaged
+#elif defined(STREAM_LINES)
+    StreamSender streamer; // Bytes the robot is still holding, line by line
+    StartStreaming(&streamer, RobotLink(), STREAM_LINES);
+    AttachSink(&sinks, StreamSink(&streamer)); // Send the command as soon as the robot has room for it
+#else
+    AttachSink(&sinks, SerialSink()); // Send the command to the robot
+#endif
+#ifdef MIRROR_GCODE
+    int mirroring = OpenGCodeWriter(&mirror, MIRROR_GCODE) == 0;
+    if (mirroring)
+    {
+        AttachSink(&sinks, FileSink(&mirror));
+    }
+#endif
+    attachOptionalSinks(&sinks, &preview, &stats);
+
+#if defined(CALIBRATE_PEN_SETTLE)
+    calibratePenSettle(&sinks);
+#elif defined(REPLAY_GCODE)
+    //Send a program that was generated earlier, the file brings its own preamble
+    replayGCodeFile(REPLAY_GCODE, &sinks);
+#elif defined(REPLAY_JOB)
+    //The same for a job file, which decodes back to the lines it was made from
+    replayJobFile(REPLAY_JOB, &sinks);
+#else
+#ifdef PULL_GENERATOR
+    streamText(inputTextPath, fontArray, characterCount, textHeight, &sinks);
+#else
+    drawText(inputTextPath, fontArray, characterCount, scaleFactor, &sinks);
+#endif
+#endif
+    FinishSinks(&sinks);
+#ifdef MIRROR_GCODE
+    if (mirroring)
+    {
+        CloseGCodeWriter(&mirror);
+    }
+#endif
     
     CloseRS232Port();
     printf("Com port now closed\n");
@@ -115,164 +277,559 @@ double promptTextHeight()
 
 double computeScaleFactor(double textHeight) 
 {
-    return textHeight / 18.0; //Scale factor calculated 
+    return textHeight / FONT_HEIGHT_UNITS; //Scale factor calculated 
+}
+
+//Main function to convert text to GCode, the laid-out moves are appended to motion
+void convertTextToGCode(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, MotionBuffer *motion) 
+{
+    char *text = readTextFile(filename); // The whole text, the layout reads it word by word
+    TextLayout layout; // Word reading and line placement, shared with the pull generator
+    LayoutEvent event;
+
+    if (!text)
+    {
+        return; 
+    }
+
+#ifdef OPTIMAL_LINE_BREAKS
+    StartTextLayout(&layout, text, fontArray, characterCount, scaleFactor, 1); // Each paragraph is laid out whole with the line breaker
+#else
+    StartTextLayout(&layout, text, fontArray, characterCount, scaleFactor, 0); // Words are wrapped greedily as they come
+#endif
+
+    while ((event = AdvanceLayout(&layout, motion)) != LAYOUT_END && event != LAYOUT_ERROR)
+    {
+        if (event == LAYOUT_WORD)
+        {
+            printf("Processing word: %s\n", layout.word); // Log the word being processed
+        }
+        else if (event == LAYOUT_NEWLINE)
+        {
+            printf("Line break. Moving to next line at Y position %.2f\n", layout.yPos);
+        }
+    }
+
+    PrintGlyphCacheStats(&layout.glyphs);
+    FreeTextLayout(&layout);
+    free(text);
 }
 
-void SendCommands(char *buffer)
+// Snaps every point to the steps the robot can actually reach and merges the ones that land together.
+// Returns the decimal places that are then enough to print a position exactly.
+int snapToMachineGrid(MotionBuffer *motion)
 {
-    PrintBuffer(&buffer[0]); // Print the buffer to the robot
-    WaitForReply(); //Wait for the robot's response
-    Sleep(100); //Add a slight delay for command execution
+#ifdef MACHINE_GRID
+    MachineGrid grid; // Steps per mm of the robot's axes
+
+    StartMachineGrid(&grid, GRID_STEPS_PER_MM_X, GRID_STEPS_PER_MM_Y);
+    QuantizeMotion(motion, &grid);
+    PrintMachineGridStats(&grid);
+    return grid.decimals;
+#else
+    (void)motion;
+    return ENCODER_DECIMALS; // Points go out as laid out, at the usual precision
+#endif
 }
 
-//Main function to convert text to GCode
-void convertTextToGCode(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor) 
+// Plans the job the way the controller will, to say up front how long drawing takes and where the time goes
+void estimateTime(const MotionBuffer *motion)
 {
-    FILE *file = fopen(filename, "r"); // Open the text file for reading
-    if (!file) 
+#ifdef ESTIMATE_TIME
+    PlannerSettings settings; // Accelerations, rates and pen timing of the robot
+    JobEstimate estimate;
+
+    DefaultPlannerSettings(&settings);
+    settings.penTime = LoadPenSettle() / 1000.0; // The dwell after each pen change is the only wait left
+    if (EstimateJob(motion, &settings, &estimate) == 0)
     {
-        printf("Error: Unable to open text file %s\n", filename); // Error message if the file cannot be opened
-        return; 
+        PrintJobEstimate(&estimate);
     }
+    FreeJobEstimate(&estimate);
+#else
+    (void)motion;
+#endif
+}
 
-    double xPos = 0; // Current X-coordinate position for text drawing
-    double yPos = 0; // Current Y-coordinate position for text drawing
-    char word[100]; // Buffer to hold words read from the file
-    int ch; // Variable to store each character read from the file
+// Encodes every step of the laid-out job as G-code and hands it to the sinks
+void sendMotion(const MotionBuffer *motion, int decimals, const SinkList *sinks)
+{
+    SendState state; // Pen tracking, peephole and encoder for this job
+
+    startSending(&state, decimals, sinks);
 
-    // Define states for processing text
-    enum ProcessingState 
+    for (size_t i = 0; i < motion->count; i++)
     {
-        SEEKING_WORD,       // State where the program looks for the next word
-        PROCESSING_WORD,    // State where the program processes a found word
-        HANDLING_NEWLINE    // State for handling new lines
-    } 
-    state = SEEKING_WORD; // Initialize the state to SEEKING_WORD
+        sendStep(&motion->records[i], &state);
+    }
+
+    finishSending(&state);
+}
 
-    while ((ch = fgetc(file)) != EOF) // Read the file character by character until end of file
+#ifdef REORDER_ANYTIME
+// Sends the job line by line while a background thread orders the lines that have not gone yet.
+// The first line goes out in whatever order is ready, so drawing starts as soon as it would without ordering.
+void sendMotionAnytime(const MotionBuffer *motion, int decimals, const SinkList *sinks)
+{
+    AnytimeOrder anytime; // Background ordering of the lines still to be sent
+    MotionBuffer line = {0}; // The line being sent, when it had to be rebuilt in a new order
+    SendState state;
+
+    if (StartAnytime(&anytime, motion) != 0)
+    {
+        sendMotion(motion, decimals, sinks); // No memory to order anything, send it as laid out
+        return;
+    }
+
+    startSending(&state, decimals, sinks);
+
+    for (int k = 0; k < anytime.lineCount; k++)
     {
-        switch (state) 
+        size_t count;
+        const MotionRecord *records = TakeAnytimeLine(&anytime, k, &line, &count); // Best order so far is final for this line
+
+        for (size_t i = 0; i < count; i++)
         {
-            case SEEKING_WORD:
-                if (ch <= 32) // Skip non-printable characters and spaces
-                {
-                    if (ch == 10) // Handle newlines
-                    {
-                        xPos = 0; // Reset X position for the new line
-                        yPos -= LINE_SPACING_MM + 10; // Move down the Y position for the next line
-                        printf("Line break. Moving to next line at Y position %.2f\n", yPos);
-                    }
-                    continue; 
-                }
-
-                ungetc(ch, file); // Put the character back into the stream for word reading
-
-                if (fscanf(file, "%99s", word) != 1) // Attempt to read a word into the buffer
-                {
-                    break; 
-                }
-
-                // Check if all characters in the word are valid according to the loaded font
-                for (int i = 0; word[i] != '\0'; i++) 
-                {
-                    int charFound = 0;
-                    for (int j = 0; j < characterCount; j++) 
-                    {
-                        if (fontArray[j].asciiCode == word[i]) 
-                        {
-                            charFound = 1; // Character is supported by the loaded font
-                            break;
-                        }
-                    }
-
-                    if (!charFound) 
-                    {
-                        printf("Error: Character '%c' is not supported by the loaded font.\n", word[i]);
-                        fclose(file);
-                        return; // Exit function if unsupported character is encountered
-                    }
-                }
-
-                printf("Processing word: %s\n", word); // Log the word being processed
-                state = PROCESSING_WORD; // Transition to the PROCESSING_WORD state
-                break;
-
-            case PROCESSING_WORD:
-                {
-                    double wordWidth = calculateWordWidth(word, fontArray, characterCount, scaleFactor); // Calculate the word's width
-
-                    if (xPos + wordWidth > MAX_LINE_WIDTH_MM) // Check if the word exceeds the line width
-                    {
-                        xPos = 0; 
-                        yPos -= LINE_SPACING_MM + 10; 
-                    }
-
-                    // Iterate through each character in the word
-                    for (int i = 0; word[i] != '\0'; i++) 
-                    {
-                        FontCharacter *charData = NULL; // Pointer to store character data
-
-                        for (int j = 0; j < characterCount; j++) 
-                        {
-                            if (fontArray[j].asciiCode == word[i]) // Find the corresponding font data for the character
-                            {
-                                charData = &fontArray[j];
-                                break;
-                            }
-                        }
-
-                        if (charData) // If character data is found, generate G-code for it
-                        {
-                            for (int k = 0; k < charData->strokeTotal; k++) 
-                            {
-                                int x = charData->strokeData[k][0]; // X coordinate for the stroke
-                                int y = charData->strokeData[k][1]; // Y coordinate for the stroke
-                                int penState = charData->strokeData[k][2]; // Pen state (up/down)
-
-                                double adjustedX = xPos + x * scaleFactor; // Adjust X coordinate by scale factor
-                                double adjustedY = yPos + y * scaleFactor; // Adjust Y coordinate by scale factor
-
-                                char buffer[100]; 
-
-                                if (penState == 0) // Pen up movement
-                                { 
-                                    sprintf(buffer, "G0 X%.2f Y%.2f\n", adjustedX, adjustedY); // Change to S0 when using the robot
-                                } 
-                                else // Pen down movement
-                                { 
-                                    sprintf(buffer, "G1 X%.2f Y%.2f\n", adjustedX, adjustedY); // Change to S1000 when using the robot
-                                }
-                                printGCodeLine(buffer); // Print the G-code line for debugging
-                                SendCommands(buffer); // Send the command to the robot
-                            }
-                            xPos += 15.0 * scaleFactor; // Update the X position for the next character
-                        }
-                    }
-                    xPos += 5.0 * scaleFactor; // Add spacing after the word
-                    state = SEEKING_WORD; // Return to SEEKING_WORD state for the next word
-                }
-                break;
+            sendStep(&records[i], &state);
         }
     }
-    fclose(file); 
+
+    StopAnytime(&anytime);
+    FreeMotion(&line);
+    finishSending(&state);
+}
+#endif
+
+// Resets pen tracking, the peephole optimizer and the encoder for a new job
+void startSending(SendState *state, int decimals, const SinkList *sinks)
+{
+    StartPenTracker(&state->pen);
+    StartPeephole(&state->peephole, decimals);
+#ifdef MODAL_GCODE
+    StartEncoder(&state->encoder, 1, decimals);
+#else
+    StartEncoder(&state->encoder, 0, decimals);
+#endif
+    state->sinks = sinks;
+    state->settleMs = LoadPenSettle();
 }
 
+// Passes one layout step through pen tracking and the peephole optimizer, sending whatever comes out
+void sendStep(const MotionRecord *record, SendState *state)
+{
+    MotionRecord steps[PEN_MAX_STEPS]; // What one layout step turns into once pen changes are added
+    MotionRecord ready[PEEPHOLE_WINDOW]; // Steps the peephole optimizer has finished with
+    int stepCount = TrackPen(&state->pen, record, steps); // Add a pen lift or drop if the state changes
 
-// Helper function to calculate word width (not necessary)
-double calculateWordWidth(const char* word, FontCharacter *fontArray, int characterCount, double scaleFactor) 
+    for (int k = 0; k < stepCount; k++)
+    {
+        if (PushPeephole(&state->peephole, &steps[k], ready))
+        {
+            sendRecord(&ready[0], state);
+        }
+    }
+}
+
+// Lifts the pen at the end of the job, sends whatever the peephole optimizer still holds and prints the stats
+void finishSending(SendState *state)
 {
-    double wordWidth = 0.0;
-    for (int i = 0; word[i] != '\0'; i++) 
+    MotionRecord steps[PEN_MAX_STEPS];
+    MotionRecord ready[PEEPHOLE_WINDOW];
+    int stepCount = FinishPen(&state->pen, steps); // Leave the pen up at the end of the job
+
+    for (int k = 0; k < stepCount; k++)
     {
-        for (int j = 0; j < characterCount; j++) 
+        if (PushPeephole(&state->peephole, &steps[k], ready))
         {
-            if (fontArray[j].asciiCode == word[i]) 
-            {
-                wordWidth += 15.0 * scaleFactor;
-                break;
-            }
+            sendRecord(&ready[0], state);
         }
     }
-    wordWidth += 5.0 * scaleFactor;
-    return wordWidth;
+
+    int readyCount = FlushPeephole(&state->peephole, ready); // Whatever is still held back at the end of the job
+    for (int k = 0; k < readyCount; k++)
+    {
+        sendRecord(&ready[k], state);
+    }
+
+    printf("Pen lifts: %ld, pen drops: %ld, lifts saved: %ld\n", state->pen.penLifts, state->pen.penDrops, state->pen.liftsSaved);
+    PrintPeepholeStats(&state->peephole);
+    PrintEncoderStats(&state->encoder);
+}
+
+// Encodes one step as a line of G-code and sends it to the robot, or appends it to the export file
+void sendRecord(const MotionRecord *record, SendState *state)
+{
+    char buffer[ENCODER_MAX_LINE]; 
+    int length = EncodeStep(&state->encoder, record, buffer); // Turn the step into a line of G-code
+
+    if (length == 0)
+    {
+        return; // The robot is already in the state this step asks for
+    }
+    EmitCommand(state->sinks, buffer, (size_t)length); // Every sink gets the same buffer, nothing is copied
+
+    // Let the servo finish moving before the next command, on the robot rather than by waiting here
+    MotionRecord dwell;
+    if ((record->op == MOTION_PEN_UP || record->op == MOTION_PEN_DOWN) && SettleDwell(state->settleMs, record, &dwell))
+    {
+        length = EncodeStep(&state->encoder, &dwell, buffer);
+        EmitCommand(state->sinks, buffer, (size_t)length);
+    }
+}
+
+// Lays the text out once into memory, then stamps a copy of it at every grid placement.
+// Each extra copy only costs a few multiplies per move instead of a full layout.
+void imposeTextOnGrid(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, const SinkList *sinks)
+{
+    MotionBuffer job = {0}; // The laid-out job, in the coordinates of a single copy
+    MotionBuffer sheet = {0}; // Every copy, in sheet coordinates
+    Placement placements[IMPOSITION_COLUMNS * IMPOSITION_ROWS]; // Where each copy goes, in drawing order
+
+    convertTextToGCode(filename, fontArray, characterCount, scaleFactor, &job);
+#if defined(REORDER_PAGE)
+    ReorderStrokesByPage(&job); // Optimize the single copy once, every stamp inherits the better order
+#elif defined(REORDER_STROKES)
+    ReorderStrokesByLine(&job);
+#endif
+
+    int placementCount = BuildPlacementGrid(&job, IMPOSITION_COLUMNS, IMPOSITION_ROWS, IMPOSITION_GAP_MM, IMPOSITION_ROTATION_DEG, placements);
+    printf("Imposing %zu moves onto %d placements\n", job.count, placementCount);
+
+    for (int p = 0; p < placementCount; p++)
+    {
+        if (StampMotion(&job, &placements[p], &sheet) != 0)
+        {
+            break;
+        }
+    }
+    // Turning a copy rounds its arc offsets again, so each is checked as it will be printed
+    if (ConformArcs(&sheet, ENCODER_DECIMALS) >= 0 && preflightJob(&sheet) == 0) // Check the whole sheet, as that is what the robot will be asked to reach
+    {
+        int decimals = snapToMachineGrid(&sheet); // Snap after stamping, in sheet coordinates, so every copy is on the grid
+        estimateTime(&sheet);
+        sendPreamble(sinks);
+        sendMotion(&sheet, decimals, sinks);
+    }
+
+    FreeMotion(&job);
+    FreeMotion(&sheet);
+}
+
+// Lays the text out, optimizes it as configured above and hands it to the sinks
+void drawText(const char *filename, FontCharacter *fontArray, int characterCount, double scaleFactor, const SinkList *sinks)
+{
+#ifdef IMPOSITION_MODE
+    //Lay the text out once and draw it several times
+    imposeTextOnGrid(filename, fontArray, characterCount, scaleFactor, sinks);
+#else
+    //Call processTextFileTest function, then encode and send what it laid out
+    MotionBuffer motion = {0};
+    convertTextToGCode(filename, fontArray, characterCount, scaleFactor, &motion);
+#if defined(REORDER_PAGE)
+    ReorderStrokesByPage(&motion);
+#elif defined(REORDER_STROKES)
+    ReorderStrokesByLine(&motion);
+#endif
+    if (preflightJob(&motion) == 0) // Nothing, not even the preamble, is sent for a job that would leave the work area
+    {
+        int decimals = snapToMachineGrid(&motion); // Decimal places the encoder prints
+        estimateTime(&motion);
+        sendPreamble(sinks);
+#ifdef REORDER_ANYTIME
+        sendMotionAnytime(&motion, decimals, sinks);
+#else
+        sendMotion(&motion, decimals, sinks);
+#endif
+    }
+    FreeMotion(&motion);
+#endif
+}
+
+#ifdef PULL_GENERATOR
+// Pulls the job from the generator one command at a time and sends each as soon as it exists.
+// Only the word being drawn is ever laid out, so the first command goes out before the rest of the text is looked at.
+// The layout is the one convertTextToGCode runs, so the G-code is the same as drawText sends with the same toggles.
+void streamText(const char *filename, FontCharacter *fontArray, int characterCount, double textHeight, const SinkList *sinks)
+{
+    char *text = readTextFile(filename);
+    JobGenerator *job; // Lays out and encodes the text on demand
+    JobCommand command; // The command the generator handed out last
+    JobSettings settings = {0}; // The toggles above that the generator follows
+
+#ifdef OPTIMAL_LINE_BREAKS
+    settings.optimalBreaks = 1;
+#endif
+#ifdef MODAL_GCODE
+    settings.modal = 1;
+#endif
+#ifdef MACHINE_GRID
+    settings.machineGrid = 1;
+#endif
+
+    if (!text)
+    {
+        return;
+    }
+    job = BeginJob(text, fontArray, characterCount, textHeight, &settings);
+    if (!job)
+    {
+        free(text);
+        return;
+    }
+    sendPreamble(sinks); // The job is never whole in memory, so each word is checked against the soft limits just before it goes
+
+    while (NextJobCommand(job, &command))
+    {
+        EmitCommand(sinks, command.text, (size_t)command.length);
+    }
+
+    if (JobFailed(job))
+    {
+        printf("Error: The job stopped early, the pen has been lifted.\n");
+    }
+    PrintJobStats(job);
+    EndJob(job);
+    free(text);
+}
+#endif
+
+// Reads the whole text file into a string, NULL if it cannot be opened or memory runs out
+char *readTextFile(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    char *text;
+    long size;
+
+    if (!file)
+    {
+        printf("Error: Unable to open text file %s\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (!text)
+    {
+        printf("Error: Unable to allocate memory for the text.\n");
+        fclose(file);
+        return NULL;
+    }
+    text[fread(text, 1, (size_t)size, file)] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Measures the whole laid-out job, travel included, and checks it against the soft limits.
+// Returns 0 if it may be sent, possibly after being shrunk to fit, or -1 if it must not be.
+int preflightJob(MotionBuffer *motion)
+{
+    SoftLimits limits; // The work area the controller will accept
+    JobBounds bounds;
+
+    DefaultSoftLimits(&limits);
+    MeasureJob(motion, &bounds); // One pass, linear in the number of moves
+    if (JobFitsLimits(&bounds, &limits))
+    {
+        return (0);
+    }
+
+    PrintJobBounds(&bounds, &limits);
+#ifdef FIT_TO_LIMITS
+    double scale = FitJobToLimits(motion, &bounds, &limits);
+    if (scale > 0.0)
+    {
+        printf("Job shrunk to %.1f%% of its size to fit the work area\n", scale * 100.0);
+        PrintJobBounds(&bounds, &limits);
+        return (0);
+    }
+    printf("Error: The job cannot be shrunk enough to fit the work area, nothing has been sent.\n");
+#else
+    printf("Error: The job would leave the work area, nothing has been sent.\n");
+#endif
+    return (-1);
+}
+
+// These commands get the robot into 'ready to draw mode' and need to be sent before any writing commands
+void sendPreamble(const SinkList *sinks)
+{
+    const char *preamble[] = { "G1 X0 Y0 F1000\n", "M3\n", "S0\n" };
+
+    for (int k = 0; k < 3; k++)
+    {
+        EmitCommand(sinks, preamble[k], strlen(preamble[k]));
+    }
+}
+
+#if defined(EXPORT_GCODE) || defined(EXPORT_JOB)
+// Writes the whole program, preamble included, to a .gcode file and/or a job file instead of sending it
+int exportProgram(const char *filename, FontCharacter *fontArray, int characterCount, double textHeight)
+{
+    SinkList sinks; // The files, plus the preview and stats when they are turned on
+    Preview preview;
+    SinkStats stats;
+    int failed = 0;
+#ifdef EXPORT_GCODE
+    GCodeWriter writer; // Buffers the program and writes it to disk in large blocks
+
+    if (OpenGCodeWriter(&writer, EXPORT_GCODE) != 0)
+    {
+        return 1;
+    }
+#endif
+#ifdef EXPORT_JOB
+    JobWriter job; // Stores each line as a delta-encoded record, or as text if it is not one the encoder makes
+    int modal, decimals;
+
+    jobFileSettings(&modal, &decimals);
+    if (OpenJobWriter(&job, EXPORT_JOB, modal, decimals) != 0)
+    {
+#ifdef EXPORT_GCODE
+        CloseGCodeWriter(&writer);
+#endif
+        return 1;
+    }
+#endif
+    StartSinks(&sinks);
+#ifdef EXPORT_GCODE
+    AttachSink(&sinks, FileSink(&writer)); // No logging, the file is the record
+#endif
+#ifdef EXPORT_JOB
+    AttachSink(&sinks, JobSink(&job));
+#endif
+    attachOptionalSinks(&sinks, &preview, &stats);
+
+#ifdef PULL_GENERATOR
+    streamText(filename, fontArray, characterCount, textHeight, &sinks);
+#else
+    drawText(filename, fontArray, characterCount, computeScaleFactor(textHeight), &sinks);
+#endif
+    FinishSinks(&sinks);
+#ifdef EXPORT_GCODE
+    failed |= CloseGCodeWriter(&writer) != 0;
+#endif
+#ifdef EXPORT_JOB
+    failed |= CloseJobWriter(&job) != 0;
+#endif
+    return failed ? 1 : 0;
+}
+#endif
+
+#ifdef EXPORT_JOB
+// The job file keeps a line as a compact record only if an encoder set up like this one prints it identically,
+// so these must match how sendMotion and the pull generator encode; anything else still works, but as text
+void jobFileSettings(int *modal, int *decimals)
+{
+#ifdef MODAL_GCODE
+    *modal = 1;
+#else
+    *modal = 0;
+#endif
+#ifdef MACHINE_GRID
+    MachineGrid grid;
+
+    StartMachineGrid(&grid, GRID_STEPS_PER_MM_X, GRID_STEPS_PER_MM_Y);
+    *decimals = grid.decimals;
+#else
+    *decimals = ENCODER_DECIMALS;
+#endif
+}
+#endif
+
+#ifdef REPLAY_GCODE
+// Streams an existing .gcode file to the sinks line by line, with no layout or encoding at all
+void replayGCodeFile(const char *path, const SinkList *sinks)
+{
+    GCodeReader reader; // Reads the file in large blocks and hands it out a line at a time
+    char line[GCODE_MAX_LINE];
+    long sent = 0;
+    int length;
+
+    if (OpenGCodeReader(&reader, path) != 0)
+    {
+        return;
+    }
+    while ((length = ReadGCodeLine(&reader, line)) > 0)
+    {
+        EmitCommand(sinks, line, (size_t)length);
+        sent++;
+    }
+    CloseGCodeReader(&reader);
+
+    printf("Replayed %ld lines from %s%s\n", sent, path, length < 0 ? ", stopped at a line that was too long" : "");
+}
+#endif
+
+#ifdef REPLAY_JOB
+// Decodes a job file to the sinks line by line; the reader holds its own buffer, so nothing is allocated while sending
+void replayJobFile(const char *path, const SinkList *sinks)
+{
+    static JobReader reader; // Too large to be comfortable on the stack
+    char line[GCODE_MAX_LINE];
+    long sent = 0;
+    int length;
+
+    if (OpenJobReader(&reader, path) != 0)
+    {
+        return;
+    }
+#ifdef REPLAY_FROM_PAGE
+    //Resume part way: lift the pen, go to where the page starts and carry on from there
+    if (SeekJobPage(&reader, REPLAY_FROM_PAGE - 1) != 0)
+    {
+        CloseJobReader(&reader);
+        return;
+    }
+    if (REPLAY_FROM_PAGE > 1)
+    {
+        sendPreamble(sinks); // The file's own preamble is behind us
+    }
+#endif
+    while ((length = ReadJobLine(&reader, line)) > 0)
+    {
+        EmitCommand(sinks, line, (size_t)length);
+        sent++;
+    }
+    CloseJobReader(&reader);
+
+    printf("Replayed %ld lines from %s%s\n", sent, path, length < 0 ? ", stopped at a damaged command" : "");
+}
+#endif
+
+#ifdef CALIBRATE_PEN_SETTLE
+// Draws a row of marks with longer and longer dwells after each pen change and asks which is the first clean one
+void calibratePenSettle(const SinkList *sinks)
+{
+    int mark = 0;
+
+    sendPreamble(sinks);
+    DrawSettleCalibration(sinks);
+
+    printf("Counting from 1 at the left, which is the first mark that starts cleanly and has no tail? ");
+    if (scanf("%d", &mark) != 1 || SettleForMark(mark) < 0)
+    {
+        printf("Error: Expected a mark from 1 to %d, the settle time was not changed\n", SETTLE_MARKS);
+        return;
+    }
+    SavePenSettle(SettleForMark(mark));
+}
+#endif
+
+// Attaches the preview and statistics sinks that are turned on above; they work the same whatever else is attached
+void attachOptionalSinks(SinkList *sinks, Preview *preview, SinkStats *stats)
+{
+#if !defined(PREVIEW_JOB) && !defined(SINK_STATS)
+    (void)sinks;
+#endif
+#ifdef PREVIEW_JOB
+    AttachSink(sinks, PreviewSink(preview));
+#else
+    (void)preview;
+#endif
+#ifdef SINK_STATS
+    AttachSink(sinks, StatsSink(stats));
+#else
+    (void)stats;
+#endif
 }
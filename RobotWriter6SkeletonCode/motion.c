@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "motion.h"
+
+
+#define FULL_TURN               6.283185307179586
+
+
+// Add one step to the end of the buffer, doubling the array when it is full
+int AppendMotion (MotionBuffer *motion, int op, int32_t x, int32_t y)
+{
+    MotionRecord record;
+
+    record.x = x;
+    record.y = y;
+    record.i = 0;
+    record.j = 0;
+    record.op = (uint8_t)op;
+
+    return AppendMotionRecord(motion, &record);
+}
+
+int AppendMotionRecord (MotionBuffer *motion, const MotionRecord *record)
+{
+    if (motion->count == motion->capacity)
+    {
+        size_t newCapacity = motion->capacity ? motion->capacity * 2 : 1024;
+        MotionRecord *newRecords = realloc(motion->records, newCapacity * sizeof(MotionRecord));
+
+        if (!newRecords)
+        {
+            printf("Error: Unable to allocate memory for the motion buffer.\n");
+            return (-1);
+        }
+        motion->records = newRecords;
+        motion->capacity = newCapacity;
+    }
+
+    motion->records[motion->count++] = *record;
+
+    return (0);
+}
+
+MotionRecord *ExtendMotion (MotionBuffer *motion, size_t count)
+{
+    if (motion->count + count > motion->capacity)
+    {
+        size_t newCapacity = motion->capacity ? motion->capacity * 2 : 1024;
+        MotionRecord *newRecords;
+
+        while (newCapacity < motion->count + count)
+        {
+            newCapacity *= 2;
+        }
+        newRecords = realloc(motion->records, newCapacity * sizeof(MotionRecord));
+        if (!newRecords)
+        {
+            printf("Error: Unable to allocate memory for the motion buffer.\n");
+            return NULL;
+        }
+        motion->records = newRecords;
+        motion->capacity = newCapacity;
+    }
+
+    motion->count += count;
+    return &motion->records[motion->count - count];
+}
+
+// Enough chords that none strays more than MOTION_CHORD_ERROR from the curve, the last ending exactly on the arc's end
+int AppendArcAsLines (MotionBuffer *motion, int32_t fromX, int32_t fromY, const MotionRecord *arc)
+{
+    double centreX = (double)fromX + arc->i;
+    double centreY = (double)fromY + arc->j;
+    double radius = sqrt((double)arc->i * arc->i + (double)arc->j * arc->j);
+    double from = atan2(fromY - centreY, fromX - centreX);
+    double sweep = atan2(arc->y - centreY, arc->x - centreX) - from;
+    double step = radius > MOTION_CHORD_ERROR ? 2.0 * acos(1.0 - MOTION_CHORD_ERROR / radius) : FULL_TURN;
+    int count, k;
+
+    // Equal ends are a full circle, as the controller reads them
+    if (arc->op == MOTION_ARC_CCW && sweep <= 0.0)
+    {
+        sweep += FULL_TURN;
+    }
+    else if (arc->op == MOTION_ARC_CW && sweep >= 0.0)
+    {
+        sweep -= FULL_TURN;
+    }
+
+    count = (int)ceil(fabs(sweep) / step);
+    for (k = 1; k < count; k++)
+    {
+        double angle = from + sweep * k / count;
+
+        if (AppendMotion(motion, MOTION_DRAW, (int32_t)lround(centreX + radius * cos(angle)), (int32_t)lround(centreY + radius * sin(angle))) != 0)
+        {
+            return (-1);
+        }
+    }
+    return AppendMotion(motion, MOTION_DRAW, arc->x, arc->y);
+}
+
+void ClearMotion (MotionBuffer *motion)
+{
+    motion->count = 0;
+}
+
+void FreeMotion (MotionBuffer *motion)
+{
+    free(motion->records);
+    motion->records = NULL;
+    motion->count = 0;
+    motion->capacity = 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdint.h>
+
+
+#ifndef MOTION_H_INCLUDED
+#define MOTION_H_INCLUDED
+
+
+#define MOTION_UNITS_PER_MM     1000            /* Fixed-point resolution: coordinates are stored in micrometres */
+
+#define MOTION_TRAVEL           0               /* Move with the pen up (G0) */
+#define MOTION_DRAW             1               /* Move with the pen down (G1) */
+#define MOTION_PEN_UP           2               /* Lift the pen (S0), x and y hold the current position */
+#define MOTION_PEN_DOWN         3               /* Lower the pen (S1000), x and y hold the current position */
+#define MOTION_ARC_CW           4               /* Clockwise arc with the pen down (G2), i and j locate the centre */
+#define MOTION_ARC_CCW          5               /* Anticlockwise arc with the pen down (G3) */
+#define MOTION_LINE             6               /* Marks the start of a text line, y holds its baseline, nothing is sent */
+#define MOTION_DWELL            7               /* Wait on the controller (G4) for i milliseconds, x and y hold the current position */
+
+#define MOTION_MAX_ARC_OFFSET   32767           /* Largest centre offset an arc record can hold, in micrometres */
+#define MOTION_CHORD_ERROR      5.0             /* Furthest a line standing in for part of an arc may stray from it, in micrometres */
+
+typedef struct
+{
+    int32_t x;                                  // X coordinate in micrometres
+    int32_t y;                                  // Y coordinate in micrometres
+    int16_t i;                                  // Arcs only: centre minus start point, X, in micrometres
+    int16_t j;                                  // Arcs only: centre minus start point, Y, in micrometres
+    uint8_t op;                                 // One of the MOTION_ operations above
+} MotionRecord;                                 // One step of a job, 16 bytes
+
+typedef struct
+{
+    MotionRecord *records;                      // Steps in the order they are drawn
+    size_t count;                               // Number of steps stored
+    size_t capacity;                            // Number of steps the array can hold
+} MotionBuffer;                                 // The laid-out job, between layout and G-code encoding
+
+int AppendMotion (MotionBuffer *motion, int op, int32_t x, int32_t y);     // Returns -1 if out of memory
+int AppendMotionRecord (MotionBuffer *motion, const MotionRecord *record);  // Copies a record, arcs included
+MotionRecord *ExtendMotion (MotionBuffer *motion, size_t count);           // Adds count steps for the caller to fill in, NULL if out of memory
+int AppendArcAsLines (MotionBuffer *motion, int32_t fromX, int32_t fromY, const MotionRecord *arc);  // Draws along an arc from (fromX, fromY) in chords; -1 if out of memory
+void ClearMotion (MotionBuffer *motion);                                    // Empties the buffer but keeps its memory
+void FreeMotion (MotionBuffer *motion);
+
+static inline int32_t MotionFromMM (double mm)
+{
+    return (int32_t)(mm >= 0.0 ? mm * MOTION_UNITS_PER_MM + 0.5 : mm * MOTION_UNITS_PER_MM - 0.5);
+}
+
+static inline double MotionToMM (int32_t units)
+{
+    return (double)units / MOTION_UNITS_PER_MM;
+}
+
+static inline int IsArc (int op)
+{
+    return op == MOTION_ARC_CW || op == MOTION_ARC_CCW;
+}
+
+static inline int IsMove (int op)               // Anything that changes the pen position
+{
+    return op == MOTION_TRAVEL || op == MOTION_DRAW || IsArc(op);
+}
+
+#endif // MOTION_H_INCLUDED
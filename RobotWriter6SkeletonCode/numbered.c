@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numbered.h"
+
+
+int NumberedChecksum (const char *text, size_t length)
+{
+    unsigned char checksum = 0;
+    size_t k;
+
+    for (k = 0; k < length; k++)
+    {
+        checksum ^= (unsigned char)text[k];
+    }
+    return checksum;
+}
+
+static int SendHistory (NumberedSender *sender, long number)
+{
+    const NumberedLine *line = &sender->history[number % NUMBERED_HISTORY];
+
+    sender->bytes += line->length;
+    return sender->link.send(sender->link.context, line->text, (size_t)line->length);
+}
+
+// Sends every line from number onwards again: the controller drops whatever follows a damaged line.
+// Requests for lines it has already confirmed, or that have not been sent yet, are stale and ignored.
+static int ResendFrom (NumberedSender *sender, long number)
+{
+    long k;
+
+    if (number >= sender->nextNumber || number <= sender->acknowledged)
+    {
+        return (0);
+    }
+    if (number < sender->nextNumber - NUMBERED_HISTORY)
+    {
+        printf("Error: The robot asked for line %ld again, only lines %ld to %ld can be resent\n", number,
+               sender->nextNumber - NUMBERED_HISTORY, sender->nextNumber - 1);
+        return (-1);
+    }
+    for (k = number; k < sender->nextNumber; k++)
+    {
+        if (SendHistory(sender, k) != 0)
+        {
+            return (-1);
+        }
+        sender->resent++;
+    }
+    return (0);
+}
+
+// Waits until the line just sent is accepted. A "Resend: n" means the ok after it only says the controller
+// is ready again, so lines n onwards go out once more. Controllers that report the last line they accepted
+// ("ok N12", Marlin's ADVANCED_OK) let stray oks, from lines that were sent twice, be told apart; for the
+// others every ok without a resend request before it counts.
+static int AwaitAccepted (NumberedSender *sender)
+{
+    char reply[LINK_MAX_REPLY];
+    long number = sender->nextNumber - 1;
+    long resendFrom = -1;
+    int attempts = 0;
+
+    while (attempts <= NUMBERED_MAX_RETRIES)
+    {
+        int length = sender->link.receive(sender->link.context, reply, sizeof(reply), NUMBERED_TIMEOUT_MS);
+
+        if (length == LINK_REPLY_TOO_LONG)
+        {
+            printf("Error: The %s link got a reply too long to read\n", sender->link.name);
+            return (-1);
+        }
+        if (length < 0)
+        {
+            printf("Error: The %s link failed while waiting for a reply\n", sender->link.name);
+            return (-1);
+        }
+        if (length == 0)
+        {
+            // Lost, or its newline was damaged and the controller is still waiting for the end of it
+            sender->timeouts++;
+            attempts++;
+            if (ResendFrom(sender, sender->acknowledged >= 0 ? sender->acknowledged + 1 : number) != 0)
+            {
+                return (-1);
+            }
+            continue;
+        }
+
+        if (strncmp(reply, "Resend:", 7) == 0 || strncmp(reply, "rs ", 3) == 0)
+        {
+            resendFrom = strtol(reply + (reply[0] == 'R' ? 7 : 3), NULL, 10);
+            sender->resendRequests++;
+        }
+        else if (strncmp(reply, "ok", 2) == 0)
+        {
+            const char *reported = strstr(reply, " N");
+            int counted = reported != NULL;
+
+            if (counted && strtol(reported + 2, NULL, 10) > sender->acknowledged)
+            {
+                sender->acknowledged = strtol(reported + 2, NULL, 10);
+            }
+            if (resendFrom >= 0)
+            {
+                attempts++;
+                if (ResendFrom(sender, resendFrom) != 0)
+                {
+                    return (-1);
+                }
+                resendFrom = -1;
+            }
+            else if (!counted)
+            {
+                sender->acknowledged = number;
+            }
+            if (sender->acknowledged >= number)
+            {
+                return (0);
+            }
+        }
+        else if (strncmp(reply, "Error", 5) == 0 || strncmp(reply, "error", 5) == 0)
+        {
+            sender->errors++;       // The resend request that explains it comes next
+        }
+    }
+
+    printf("Error: Line %ld could not be delivered after %d attempts\n", number, NUMBERED_MAX_RETRIES);
+    return (-1);
+}
+
+int SendNumbered (NumberedSender *sender, const char *text, size_t length)
+{
+    long number = sender->nextNumber;
+    NumberedLine *line = &sender->history[number % NUMBERED_HISTORY];
+    int prefix;
+
+    if (sender->failed)
+    {
+        return (-1);
+    }
+    while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r'))
+    {
+        length--;
+    }
+    if (length + 24 > NUMBERED_MAX_LINE)
+    {
+        printf("Error: A line of %d bytes is too long to number\n", (int)length);
+        sender->failed = 1;
+        return (-1);
+    }
+
+    prefix = sprintf(line->text, "N%ld ", number);
+    memcpy(&line->text[prefix], text, length);
+    line->length = prefix + (int)length;
+    line->length += sprintf(&line->text[line->length], "*%d\n", NumberedChecksum(line->text, (size_t)line->length));
+
+    sender->nextNumber++;
+    sender->lines++;
+    sender->plainBytes += (long long)length + 1;
+    if (SendHistory(sender, number) != 0 || AwaitAccepted(sender) != 0)
+    {
+        sender->failed = 1;
+        return (-1);
+    }
+    return (0);
+}
+
+int StartNumbered (NumberedSender *sender, SerialLink link)
+{
+    memset(sender, 0, sizeof(*sender));
+    sender->link = link;
+    sender->acknowledged = -1;
+
+    // Line 0 tells the controller that the next line is 1
+    if (SendNumbered(sender, "M110 N0\n", 8) != 0)
+    {
+        return (-1);
+    }
+    sender->lines = 0;
+    sender->plainBytes = 0;
+    return (0);
+}
+
+void PrintNumberedStats (const NumberedSender *sender)
+{
+    printf("Numbered lines: %ld sent, %ld resent after %ld requests and %ld timeouts, %ld other errors, "
+           "%lld bytes (%.1f%% more than the lines alone)%s\n",
+           sender->lines, sender->resent, sender->resendRequests, sender->timeouts, sender->errors, sender->bytes,
+           sender->plainBytes > 0 ? 100.0 * (double)(sender->bytes - sender->plainBytes) / (double)sender->plainBytes : 0.0,
+           sender->failed ? ", stopped at a line that could not be delivered" : "");
+}
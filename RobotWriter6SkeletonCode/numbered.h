@@ -0,0 +1,49 @@
+#include <stdio.h>
+
+#include "link.h"
+#include "gcodefile.h"
+
+
+#ifndef NUMBERED_H_INCLUDED
+#define NUMBERED_H_INCLUDED
+
+
+#define NUMBERED_HISTORY        64              /* Lines kept for resending; a request for anything older fails the job */
+#define NUMBERED_MAX_LINE       (GCODE_MAX_LINE + 24) /* A line with its number and checksum, including the terminator */
+#define NUMBERED_TIMEOUT_MS     1000            /* Wait this long for a reply before sending the line again */
+#define NUMBERED_MAX_RETRIES    20              /* Resends and timeouts one line may cost before the job is given up */
+
+typedef struct
+{
+    char text[NUMBERED_MAX_LINE];               // As sent: "N12 G1 X1.00 Y2.00*85\n"
+    int length;
+} NumberedLine;
+
+typedef struct
+{
+    SerialLink link;
+    long nextNumber;                            // Number the next new line gets
+    long acknowledged;                          // Last line the controller has accepted, -1 before M110
+    NumberedLine history[NUMBERED_HISTORY];     // The last lines sent, line n in slot n % NUMBERED_HISTORY
+    int failed;                                 // Set once a line could not be delivered; later lines are dropped
+    long lines;                                 // New lines sent
+    long resent;                                // Lines sent again
+    long resendRequests;                        // "Resend: n" replies
+    long timeouts;                              // Replies that never came
+    long errors;                                // Other error replies
+    long long bytes;                            // Bytes sent, resends included
+    long long plainBytes;                       // Bytes the same lines take without numbers and checksums
+} NumberedSender;                               // Marlin-style numbered, checksummed lines with resend on request
+
+// Resets the controller's line numbering with M110 and waits for it to be accepted. Returns -1 if it is not.
+int StartNumbered (NumberedSender *sender, SerialLink link);
+
+// Sends one newline-terminated line as "N<number> <line>*<checksum>" and waits for the controller to accept it,
+// resending from the history whenever it asks. Returns -1 once the line cannot be delivered.
+int SendNumbered (NumberedSender *sender, const char *text, size_t length);
+
+int NumberedChecksum (const char *text, size_t length);    // XOR of the bytes, as Marlin computes it
+
+void PrintNumberedStats (const NumberedSender *sender);
+
+#endif // NUMBERED_H_INCLUDED
@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "pageorder.h"
+#include "thread.h"
+
+
+// Uniform grid over stroke ends. End e of stroke s is entry 2*s+e. Each cell keeps its live entries at the
+// front of its slice of the entries array, so removing a used stroke is a swap and a decrement.
+typedef struct
+{
+    int64_t minX, minY;                         // Corner of the grid, micrometres
+    int64_t cellSize;                           // Width and height of a cell, micrometres
+    int columns, rows;
+    int *cellStart;                             // First entry of each cell
+    int *cellLive;                              // Number of live entries in each cell
+    int *entries;                               // Stroke ends, grouped by cell
+    int *cellOf;                                // Cell of each stroke end
+    int *slotOf;                                // Position of each stroke end in entries
+} EndpointGrid;
+
+static void FreeEndpointGrid (EndpointGrid *grid)
+{
+    free(grid->cellStart);
+    free(grid->cellLive);
+    free(grid->entries);
+    free(grid->cellOf);
+    free(grid->slotOf);
+}
+
+static int CellIndex (const EndpointGrid *grid, int32_t x, int32_t y, int *column, int *row)
+{
+    int64_t c = ((int64_t)x - grid->minX) / grid->cellSize;
+    int64_t r = ((int64_t)y - grid->minY) / grid->cellSize;
+
+    // Points outside the grid (only the starting position can be) are clamped to the nearest cell
+    if (c < 0) c = 0;
+    if (c >= grid->columns) c = grid->columns - 1;
+    if (r < 0) r = 0;
+    if (r >= grid->rows) r = grid->rows - 1;
+    *column = (int)c;
+    *row = (int)r;
+    return (int)(r * grid->columns + c);
+}
+
+static void EndPoint (const Stroke *strokes, int entry, int32_t *x, int32_t *y)
+{
+    const Stroke *stroke = &strokes[entry / 2];
+
+    *x = (entry & 1) ? stroke->endX : stroke->startX;
+    *y = (entry & 1) ? stroke->endY : stroke->startY;
+}
+
+static int BuildEndpointGrid (EndpointGrid *grid, const Stroke *strokes, int count)
+{
+    int64_t maxX, maxY, width, height;
+    int ends = count * 2;
+    int cells, e, c;
+
+    grid->minX = maxX = strokes[0].startX;
+    grid->minY = maxY = strokes[0].startY;
+    for (e = 0; e < ends; e++)
+    {
+        int32_t x, y;
+
+        EndPoint(strokes, e, &x, &y);
+        if (x < grid->minX) grid->minX = x;
+        if (x > maxX) maxX = x;
+        if (y < grid->minY) grid->minY = y;
+        if (y > maxY) maxY = y;
+    }
+    width = maxX - grid->minX + 1;
+    height = maxY - grid->minY + 1;
+
+    // Aim for about two stroke ends per cell
+    grid->cellSize = (int64_t)sqrt((double)width * (double)height / (double)count) + 1;
+    grid->columns = (int)(width / grid->cellSize) + 1;
+    grid->rows = (int)(height / grid->cellSize) + 1;
+    cells = grid->columns * grid->rows;
+
+    grid->cellStart = calloc((size_t)cells + 1, sizeof(int));
+    grid->cellLive = calloc((size_t)cells, sizeof(int));
+    grid->entries = malloc((size_t)ends * sizeof(int));
+    grid->cellOf = malloc((size_t)ends * sizeof(int));
+    grid->slotOf = malloc((size_t)ends * sizeof(int));
+    if (!grid->cellStart || !grid->cellLive || !grid->entries || !grid->cellOf || !grid->slotOf)
+    {
+        FreeEndpointGrid(grid);
+        return (-1);
+    }
+
+    // Counting sort of the stroke ends into their cells
+    for (e = 0; e < ends; e++)
+    {
+        int32_t x, y;
+        int column, row;
+
+        EndPoint(strokes, e, &x, &y);
+        grid->cellOf[e] = CellIndex(grid, x, y, &column, &row);
+        grid->cellStart[grid->cellOf[e] + 1]++;
+    }
+    for (c = 0; c < cells; c++)
+    {
+        grid->cellStart[c + 1] += grid->cellStart[c];
+    }
+    for (e = 0; e < ends; e++)
+    {
+        c = grid->cellOf[e];
+        grid->slotOf[e] = grid->cellStart[c] + grid->cellLive[c];
+        grid->entries[grid->slotOf[e]] = e;
+        grid->cellLive[c]++;
+    }
+
+    return (0);
+}
+
+static void RemoveEnd (EndpointGrid *grid, int entry)
+{
+    int c = grid->cellOf[entry];
+    int lastSlot = grid->cellStart[c] + grid->cellLive[c] - 1;
+    int moved = grid->entries[lastSlot];
+
+    grid->entries[grid->slotOf[entry]] = moved;
+    grid->slotOf[moved] = grid->slotOf[entry];
+    grid->entries[lastSlot] = entry;
+    grid->slotOf[entry] = lastSlot;
+    grid->cellLive[c]--;
+}
+
+// Closest live stroke end to (x, y), searching rings of cells outwards. Returns -1 if none are left.
+static int NearestEnd (const EndpointGrid *grid, const Stroke *strokes, int32_t x, int32_t y)
+{
+    int column, row, ring, best = -1;
+    double bestDistance = 0.0;
+    int maxRing = grid->columns > grid->rows ? grid->columns : grid->rows;
+
+    CellIndex(grid, x, y, &column, &row);
+
+    for (ring = 0; ring <= maxRing; ring++)
+    {
+        int r, c;
+
+        for (r = row - ring; r <= row + ring; r++)
+        {
+            if (r < 0 || r >= grid->rows)
+            {
+                continue;
+            }
+            for (c = column - ring; c <= column + ring; c++)
+            {
+                int cell, slot;
+
+                if (c < 0 || c >= grid->columns)
+                {
+                    continue;
+                }
+                if (r != row - ring && r != row + ring && c != column - ring && c != column + ring)
+                {
+                    c = column + ring - 1;      // Inside of the ring was searched already, jump to its right edge
+                    continue;
+                }
+
+                cell = r * grid->columns + c;
+                for (slot = grid->cellStart[cell]; slot < grid->cellStart[cell] + grid->cellLive[cell]; slot++)
+                {
+                    int32_t ex, ey;
+                    double distance;
+
+                    EndPoint(strokes, grid->entries[slot], &ex, &ey);
+                    distance = PointDistance(x, y, ex, ey);
+                    if (best < 0 || distance < bestDistance)
+                    {
+                        best = grid->entries[slot];
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        // Anything in the next ring is at least ring cells away
+        if (best >= 0 && bestDistance <= (double)ring * (double)grid->cellSize)
+        {
+            break;
+        }
+    }
+
+    return (best);
+}
+
+
+double GridNearestNeighbourOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed)
+{
+    EndpointGrid grid;
+    int32_t penX = x, penY = y;
+    int k;
+
+    if (count <= 0)
+    {
+        return (0.0);
+    }
+
+    if (BuildEndpointGrid(&grid, strokes, count) != 0)
+    {
+        printf("Error: Unable to allocate memory for the stroke index, keeping the layout order.\n");
+        for (k = 0; k < count; k++)
+        {
+            order[k] = k;
+            reversed[k] = 0;
+        }
+        return StrokeTravel(strokes, count, x, y, order, reversed);
+    }
+
+    for (k = 0; k < count; k++)
+    {
+        int end = NearestEnd(&grid, strokes, penX, penY);
+        int stroke = end / 2;
+
+        // Entering at the stroke's end means drawing it backwards
+        order[k] = stroke;
+        reversed[k] = (char)(end & 1);
+        RemoveEnd(&grid, stroke * 2);
+        RemoveEnd(&grid, stroke * 2 + 1);
+        StrokeExit(&strokes[stroke], reversed[k], &penX, &penY);
+    }
+
+    FreeEndpointGrid(&grid);
+
+    return StrokeTravel(strokes, count, x, y, order, reversed);
+}
+
+
+typedef struct
+{
+    const Stroke *strokes;
+    int *order;
+    char *reversed;
+    StrokeRange range;                          // Positions this worker may change
+    double deadline;                            // WallClockMs() value to stop at
+    int improved;                               // Set if any move was made
+    int threaded;                               // 1 if the chunk runs on its own thread
+    ThreadHandle thread;
+} RefineChunk;
+
+// Windowed 2-opt over one chunk of the tour
+static void RefineChunkWorker (void *argument)
+{
+    RefineChunk *chunk = argument;
+
+    chunk->improved = TwoOptPass(chunk->strokes, chunk->order, chunk->reversed, &chunk->range, PAGE_ORDER_WINDOW, chunk->deadline);
+}
+
+double RefinePageOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, int threads, double budgetMs)
+{
+    double deadline = WallClockMs() + budgetMs;
+    RefineChunk *chunks;
+    int pass, t;
+
+    if (threads <= 0)
+    {
+        threads = CountProcessors();
+    }
+    // Chunks much shorter than the window would spend most of their time at frozen boundaries
+    if (threads > count / (PAGE_ORDER_WINDOW * 4))
+    {
+        threads = count / (PAGE_ORDER_WINDOW * 4) > 0 ? count / (PAGE_ORDER_WINDOW * 4) : 1;
+    }
+
+    chunks = malloc((size_t)threads * sizeof(RefineChunk));
+    if (!chunks)
+    {
+        return StrokeTravel(strokes, count, x, y, order, reversed);
+    }
+
+    for (pass = 0; WallClockMs() < deadline; pass++)
+    {
+        int chunkSize = count / threads;
+        int shift = (pass & 1) ? chunkSize / 2 : 0;     // Move the frozen boundaries every other pass
+        int improved = 0;
+
+        for (t = 0; t < threads; t++)
+        {
+            RefineChunk *chunk = &chunks[t];
+            int boundary = t * chunkSize + shift;       // Stroke at this position stays put during the pass
+
+            chunk->strokes = strokes;
+            chunk->order = order;
+            chunk->reversed = reversed;
+            chunk->deadline = deadline;
+            chunk->range.from = t == 0 ? 0 : boundary + 1;
+            chunk->range.to = t == threads - 1 ? count : (t + 1) * chunkSize + shift;
+            chunk->range.beforeX = x;
+            chunk->range.beforeY = y;
+            if (t > 0)
+            {
+                StrokeExit(&strokes[order[boundary]], reversed[boundary], &chunk->range.beforeX, &chunk->range.beforeY);
+            }
+            chunk->range.hasAfter = t < threads - 1;
+            if (chunk->range.hasAfter)
+            {
+                StrokeEntry(&strokes[order[chunk->range.to]], reversed[chunk->range.to], &chunk->range.afterX, &chunk->range.afterY);
+            }
+        }
+
+        // Chunks never overlap, and the strokes between them are only read, so the workers need no locking
+        for (t = 1; t < threads; t++)
+        {
+            chunks[t].threaded = StartThread(&chunks[t].thread, RefineChunkWorker, &chunks[t]) == 0;
+            if (!chunks[t].threaded)
+            {
+                RefineChunkWorker(&chunks[t]);  // No thread available, do the chunk here instead
+            }
+        }
+        RefineChunkWorker(&chunks[0]);
+        for (t = 1; t < threads; t++)
+        {
+            if (chunks[t].threaded)
+            {
+                JoinThread(chunks[t].thread);
+            }
+        }
+
+        for (t = 0; t < threads; t++)
+        {
+            improved |= chunks[t].improved;
+        }
+        if (!improved && (threads == 1 || (pass & 1)))
+        {
+            break;      // Both boundary layouts have converged
+        }
+    }
+
+    free(chunks);
+
+    return StrokeTravel(strokes, count, x, y, order, reversed);
+}
+
+
+int ReorderStrokesByPage (MotionBuffer *motion)
+{
+    MotionBuffer out = {0};
+    StrokeList list = {0};
+    int *order;
+    char *reversed;
+    double before, nearest, after, started;
+    int k;
+
+    started = WallClockMs();
+    if (ExtractStrokes(motion->records, motion->count, 0, 0, &list) != 0)
+    {
+        FreeStrokeList(&list);
+        return (-1);
+    }
+    if (list.count == 0)
+    {
+        FreeStrokeList(&list);
+        return (0);
+    }
+
+    order = malloc((size_t)list.count * sizeof(int));
+    reversed = malloc((size_t)list.count);
+    if (!order || !reversed)
+    {
+        printf("Error: Unable to allocate memory for stroke ordering.\n");
+        free(order);
+        free(reversed);
+        FreeStrokeList(&list);
+        return (-1);
+    }
+
+    before = StrokeTravel(list.strokes, list.count, 0, 0, NULL, NULL);
+    nearest = GridNearestNeighbourOrder(list.strokes, list.count, 0, 0, order, reversed);
+    after = RefinePageOrder(list.strokes, list.count, 0, 0, order, reversed, PAGE_ORDER_THREADS, PAGE_ORDER_BUDGET_MS);
+    if (list.count <= PAGE_ORDER_FULL_2OPT)
+    {
+        // Small enough for unrestricted 2-opt to finish, which also finds the long-range moves the window misses
+        after = RefineStrokeOrder(list.strokes, list.count, 0, 0, order, reversed, PAGE_ORDER_BUDGET_MS);
+    }
+
+    for (k = 0; k < list.count; k++)
+    {
+        if (AppendStroke(&out, motion->records, &list.strokes[order[k]], reversed[k]) != 0)
+        {
+            FreeMotion(&out);   // Leave the job as it was laid out
+            free(order);
+            free(reversed);
+            FreeStrokeList(&list);
+            return (-1);
+        }
+    }
+
+    printf("Page ordering: %d strokes, travel %.1f mm, nearest neighbour %.1f mm, refined %.1f mm (%.0f ms), about %.1f s saved\n",
+           list.count, before / MOTION_UNITS_PER_MM, nearest / MOTION_UNITS_PER_MM, after / MOTION_UNITS_PER_MM,
+           WallClockMs() - started, (before - after) / MOTION_UNITS_PER_MM / (REORDER_TRAVEL_FEED / 60.0));
+
+    FreeMotion(motion);
+    *motion = out;
+    free(order);
+    free(reversed);
+    FreeStrokeList(&list);
+
+    return (0);
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+#include "motion.h"
+#include "reorder.h"
+
+
+#ifndef PAGEORDER_H_INCLUDED
+#define PAGEORDER_H_INCLUDED
+
+
+#define PAGE_ORDER_BUDGET_MS    250.0           /* Time local search may spend on the whole page */
+#define PAGE_ORDER_WINDOW       48              /* How far ahead 2-opt looks from each stroke */
+#define PAGE_ORDER_THREADS      0               /* Threads for refinement, 0 uses every core, 1 stays on this thread */
+#define PAGE_ORDER_FULL_2OPT    2000            /* Jobs with up to this many strokes also get unrestricted 2-opt */
+
+// Nearest neighbour order over every stroke using a uniform grid of stroke ends, so each
+// "closest free stroke" query only looks at nearby cells. Returns the travel in micrometres.
+double GridNearestNeighbourOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed);
+
+// 2-opt limited to blocks of at most PAGE_ORDER_WINDOW strokes, run over the whole tour until budgetMs runs out.
+// With more than one thread the tour is cut into chunks that are refined side by side, and the chunk
+// boundaries move between passes so strokes near a boundary still get improved.
+double RefinePageOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, int threads, double budgetMs);
+
+// Reorders every stroke of the job as one problem, across line boundaries. Line markers are dropped because
+// lines are no longer drawn one after the other.
+int ReorderStrokesByPage (MotionBuffer *motion);
+
+#endif // PAGEORDER_H_INCLUDED
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "peephole.h"
+
+
+// Round a coordinate to the grid the encoder prints on
+static int32_t ToOutputPrecision (const Peephole *peephole, int32_t v)
+{
+    int32_t resolution = peephole->resolution;
+
+    return (v >= 0 ? (v + resolution / 2) : (v - resolution / 2)) / resolution;
+}
+
+
+void StartPeephole (Peephole *peephole, int decimals)
+{
+    memset(peephole, 0, sizeof(Peephole));
+    peephole->resolution = 1;
+    for (; decimals < 3; decimals++)
+    {
+        peephole->resolution *= 10;     // Motion units are micrometres, 3 decimals of a millimetre
+    }
+}
+
+
+int PushPeephole (Peephole *peephole, const MotionRecord *record, MotionRecord *out)
+{
+    MotionRecord *tail = peephole->count ? &peephole->window[peephole->count - 1] : NULL;
+    int released = 0;
+    int dot = 0;
+
+    peephole->seen++;
+
+    switch (record->op)
+    {
+        case MOTION_TRAVEL:
+        case MOTION_DRAW:
+            // A move to where the pen already is, including a pen down segment too short to show at the
+            // output precision, would be sent as the same coordinates again
+            if (ToOutputPrecision(peephole, record->x) == peephole->x && ToOutputPrecision(peephole, record->y) == peephole->y)
+            {
+                // Except the first draw of a stroke: that is a dot, and the pen only touches the paper if it is sent
+                if (record->op == MOTION_DRAW && peephole->penDown && !peephole->strokeDrawn)
+                {
+                    peephole->strokeDrawn = 1;
+                    dot = 1;
+                    break;
+                }
+                peephole->zeroMoves++;
+                return (0);
+            }
+
+            // Once the stroke goes somewhere the dot before it is not needed after all
+            if (record->op == MOTION_DRAW && peephole->dotHeld)
+            {
+                *tail = *record;
+                peephole->x = ToOutputPrecision(peephole, record->x);
+                peephole->y = ToOutputPrecision(peephole, record->y);
+                peephole->dotHeld = 0;
+                peephole->zeroMoves++;
+                return (0);
+            }
+
+            // Two pen up travels in a row only need the second one
+            if (record->op == MOTION_TRAVEL && tail && tail->op == MOTION_TRAVEL)
+            {
+                *tail = *record;
+                peephole->x = ToOutputPrecision(peephole, record->x);
+                peephole->y = ToOutputPrecision(peephole, record->y);
+                peephole->collapsedTravels++;
+                return (0);
+            }
+
+            peephole->x = ToOutputPrecision(peephole, record->x);
+            peephole->y = ToOutputPrecision(peephole, record->y);
+            peephole->strokeDrawn |= record->op == MOTION_DRAW;
+            break;
+
+        case MOTION_ARC_CW:
+        case MOTION_ARC_CCW:
+            // An arc that ends where it started is a full circle, so arcs are never treated as zero length
+            peephole->x = ToOutputPrecision(peephole, record->x);
+            peephole->y = ToOutputPrecision(peephole, record->y);
+            peephole->strokeDrawn = 1;
+            break;
+
+        case MOTION_PEN_UP:
+        case MOTION_PEN_DOWN:
+            if ((record->op == MOTION_PEN_DOWN) == peephole->penDown)
+            {
+                peephole->repeatedPen++;
+                return (0);
+            }
+
+            // A drop straight after a lift carries on the same stroke. A lift straight after a drop is kept,
+            // as putting the pen down and taking it up again still leaves a mark on the paper.
+            if (record->op == MOTION_PEN_DOWN && tail && tail->op == MOTION_PEN_UP)
+            {
+                peephole->count--;
+                peephole->penDown = 1;
+                peephole->cancelledPen += 2;
+                return (0);
+            }
+
+            peephole->penDown = (record->op == MOTION_PEN_DOWN);
+            if (peephole->penDown)
+            {
+                peephole->strokeDrawn = 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // The window is full, so the oldest record can no longer change and goes out
+    if (peephole->count == PEEPHOLE_WINDOW)
+    {
+        *out = peephole->window[0];
+        memmove(&peephole->window[0], &peephole->window[1], (PEEPHOLE_WINDOW - 1) * sizeof(MotionRecord));
+        peephole->count--;
+        released = 1;
+    }
+
+    peephole->window[peephole->count++] = *record;
+    peephole->dotHeld = dot;
+
+    return (released);
+}
+
+
+int FlushPeephole (Peephole *peephole, MotionRecord *out)
+{
+    int count = peephole->count;
+
+    memcpy(out, peephole->window, (size_t)count * sizeof(MotionRecord));
+    peephole->count = 0;
+    peephole->dotHeld = 0;
+
+    return (count);
+}
+
+
+long PeepholeRemoved (const Peephole *peephole)
+{
+    return peephole->zeroMoves + peephole->collapsedTravels + peephole->cancelledPen + peephole->repeatedPen;
+}
+
+
+void PrintPeepholeStats (const Peephole *peephole)
+{
+    printf("Peephole removed %ld of %ld commands: %ld zero-length moves, %ld collapsed travels, %ld cancelled pen changes, %ld repeated pen commands\n",
+           PeepholeRemoved(peephole), peephole->seen, peephole->zeroMoves, peephole->collapsedTravels,
+           peephole->cancelledPen, peephole->repeatedPen);
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef PEEPHOLE_H_INCLUDED
+#define PEEPHOLE_H_INCLUDED
+
+
+#define PEEPHOLE_WINDOW         8               /* Records held back so later ones can cancel them */
+
+typedef struct
+{
+    MotionRecord window[PEEPHOLE_WINDOW];       // Records not yet released, oldest first
+    int count;                                  // Number of records in the window
+    int32_t resolution;                         // Output precision in motion units: 10 um when the encoder prints 2 decimals
+    int32_t x;                                  // Position after the newest record, at output precision
+    int32_t y;
+    int penDown;                                // Pen state after the newest record
+    int strokeDrawn;                            // Set once a draw has been kept since the pen last went down
+    int dotHeld;                                // Set while the newest record is a zero-length draw kept as a dot
+    long seen;                                  // Records pushed in
+    long zeroMoves;                             // Moves dropped because they do not leave the current position
+    long collapsedTravels;                      // Pen up travels replaced by the travel that followed them
+    long cancelledPen;                          // Lifts straight followed by a drop, counting both commands
+    long repeatedPen;                           // Pen commands for the state the pen is already in
+} Peephole;                                     // Sliding-window optimizer between the emitter and the serial port
+
+// decimals is what the encoder prints, so a move is only dropped if it would be sent as the same coordinates
+void StartPeephole (Peephole *peephole, int decimals);
+
+// Pushes one record in. Records that leave the window are written to out and their number is returned
+// (0 or 1, the window never releases more than it receives).
+int PushPeephole (Peephole *peephole, const MotionRecord *record, MotionRecord *out);
+
+// Releases everything still held at the end of the job. out must have room for PEEPHOLE_WINDOW records.
+int FlushPeephole (Peephole *peephole, MotionRecord *out);
+
+long PeepholeRemoved (const Peephole *peephole);
+void PrintPeepholeStats (const Peephole *peephole);
+
+#endif // PEEPHOLE_H_INCLUDED
@@ -0,0 +1,109 @@
+#include <stdio.h>
+
+#include "pen.h"
+
+
+void StartPenTracker (PenTracker *pen)
+{
+    pen->penDown = 0;
+    pen->x = 0;
+    pen->y = 0;
+    pen->penLifts = 0;
+    pen->penDrops = 0;
+    pen->liftsSaved = 0;
+}
+
+
+int TrackPen (PenTracker *pen, const MotionRecord *record, MotionRecord *out)
+{
+    int count = 0;
+
+    switch (record->op)
+    {
+        case MOTION_TRAVEL:
+            if (pen->penDown)
+            {
+                // The next stroke starts exactly where this one ended, so keep drawing without a lift
+                if (record->x == pen->x && record->y == pen->y)
+                {
+                    pen->liftsSaved++;
+                    return (0);
+                }
+                out[count].op = MOTION_PEN_UP;
+                out[count].x = pen->x;
+                out[count].y = pen->y;
+                out[count].i = 0;
+                out[count].j = 0;
+                count++;
+                pen->penDown = 0;
+                pen->penLifts++;
+            }
+            break;
+
+        case MOTION_DRAW:
+        case MOTION_ARC_CW:
+        case MOTION_ARC_CCW:
+            if (!pen->penDown)
+            {
+                out[count].op = MOTION_PEN_DOWN;
+                out[count].x = pen->x;
+                out[count].y = pen->y;
+                out[count].i = 0;
+                out[count].j = 0;
+                count++;
+                pen->penDown = 1;
+                pen->penDrops++;
+            }
+            break;
+
+        case MOTION_PEN_UP:
+            if (!pen->penDown)
+            {
+                return (0);     // Already up
+            }
+            pen->penDown = 0;
+            pen->penLifts++;
+            break;
+
+        case MOTION_PEN_DOWN:
+            if (pen->penDown)
+            {
+                return (0);     // Already down
+            }
+            pen->penDown = 1;
+            pen->penDrops++;
+            break;
+
+        default:
+            return (0);
+    }
+
+    out[count] = *record;
+    count++;
+    if (IsMove(record->op))
+    {
+        pen->x = record->x;
+        pen->y = record->y;
+    }
+
+    return (count);
+}
+
+
+int FinishPen (PenTracker *pen, MotionRecord *out)
+{
+    if (!pen->penDown)
+    {
+        return (0);
+    }
+
+    out->op = MOTION_PEN_UP;
+    out->x = pen->x;
+    out->y = pen->y;
+    out->i = 0;
+    out->j = 0;
+    pen->penDown = 0;
+    pen->penLifts++;
+
+    return (1);
+}
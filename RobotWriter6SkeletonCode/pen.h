@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef PEN_H_INCLUDED
+#define PEN_H_INCLUDED
+
+
+#define PEN_MAX_STEPS           2               /* Most records TrackPen can turn one record into */
+
+typedef struct
+{
+    int penDown;                                // 1 while the pen is on the paper
+    int32_t x;                                  // Where the pen is now, in micrometres
+    int32_t y;
+    long penLifts;                              // S0 commands sent
+    long penDrops;                              // S1000 commands sent
+    long liftsSaved;                            // Lifts avoided because the next stroke started where the last one ended
+} PenTracker;                                   // Pen state as the robot sees it, so pen commands are only sent on a change
+
+void StartPenTracker (PenTracker *pen);         // The robot starts with the pen up at the origin
+
+// Turns one layout record into the records that actually need sending, adding S0/S1000 only when the
+// pen has to change state. Returns how many records were written to out (0 to PEN_MAX_STEPS).
+int TrackPen (PenTracker *pen, const MotionRecord *record, MotionRecord *out);
+
+// Lifts the pen at the end of a job if it is still down. Returns 0 or 1 records written to out.
+int FinishPen (PenTracker *pen, MotionRecord *out);
+
+#endif // PEN_H_INCLUDED
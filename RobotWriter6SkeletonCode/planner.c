@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "planner.h"
+#include "pen.h"
+
+
+#define FULL_TURN               6.28318530717958647692
+
+
+typedef struct
+{
+    double length;                              // mm
+    double nominal;                             // Cruise speed, mm/s
+    double accel;                               // mm/s^2 along the move
+    double maxEntry;                            // Fastest the move may be entered, mm/s
+    double entry;                               // Planned entry speed, mm/s
+    int ink;                                    // 1 if drawn with the pen down
+    int page;
+} PlannedBlock;
+
+typedef struct
+{
+    const PlannerSettings *settings;
+    JobEstimate *estimate;
+    PlannedBlock *blocks;                       // Moves since the robot last came to a stop
+    int count, capacity;
+    double lastX, lastY;                        // Exit direction of the last block, unit vector
+} Planner;
+
+
+void DefaultPlannerSettings (PlannerSettings *settings)
+{
+    settings->accelX = PLANNER_ACCEL_X;
+    settings->accelY = PLANNER_ACCEL_Y;
+    settings->maxRateX = PLANNER_MAX_RATE_X / 60.0;
+    settings->maxRateY = PLANNER_MAX_RATE_Y / 60.0;
+    settings->junctionDeviation = PLANNER_JUNCTION_DEV;
+    settings->drawFeed = PLANNER_DRAW_FEED / 60.0;
+    settings->penTime = PLANNER_PEN_TIME;
+    settings->pageHeight = PLANNER_PAGE_HEIGHT;
+}
+
+
+// Largest value along direction (x, y) that keeps each axis within its own limit
+static double LimitByAxis (double x, double y, double limitX, double limitY)
+{
+    double limit = HUGE_VAL;
+
+    if (fabs(x) > 1e-12 && limitX / fabs(x) < limit) limit = limitX / fabs(x);
+    if (fabs(y) > 1e-12 && limitY / fabs(y) < limit) limit = limitY / fabs(y);
+    return limit;
+}
+
+static int AddPageTime (JobEstimate *estimate, int page, double seconds)
+{
+    if (page >= estimate->pageCount)
+    {
+        double *pages = realloc(estimate->pages, (size_t)(page + 1) * sizeof(double));
+
+        if (!pages)
+        {
+            return (-1);
+        }
+        memset(&pages[estimate->pageCount], 0, (size_t)(page + 1 - estimate->pageCount) * sizeof(double));
+        estimate->pages = pages;
+        estimate->pageCount = page + 1;
+    }
+    estimate->pages[page] += seconds;
+    return (0);
+}
+
+static int PageOf (const Planner *planner, int32_t y)
+{
+    double down = -MotionToMM(y);       // Text runs down the page from y = 0
+
+    return down > 0.0 ? (int)(down / planner->settings->pageHeight) : 0;
+}
+
+// Time for one trapezoid (or triangle, if there is no room to reach the cruise speed)
+static double BlockTime (const PlannedBlock *block, double exit)
+{
+    double entry = block->entry;
+    double accel = block->accel;
+    double cruise = block->nominal;
+    double speedUp = (cruise * cruise - entry * entry) / (2.0 * accel);
+    double slowDown = (cruise * cruise - exit * exit) / (2.0 * accel);
+
+    if (speedUp + slowDown > block->length)
+    {
+        cruise = sqrt(accel * block->length + 0.5 * (entry * entry + exit * exit));
+        return (cruise - entry) / accel + (cruise - exit) / accel;
+    }
+    return (cruise - entry) / accel + (cruise - exit) / accel + (block->length - speedUp - slowDown) / cruise;
+}
+
+// The robot has stopped: plan everything since the last stop with a backward and a forward pass
+static int FinishRun (Planner *planner)
+{
+    PlannedBlock *blocks = planner->blocks;
+    double exit = 0.0;
+    int k;
+
+    for (k = planner->count - 1; k >= 0; k--)
+    {
+        double reachable = sqrt(exit * exit + 2.0 * blocks[k].accel * blocks[k].length);
+
+        blocks[k].entry = blocks[k].maxEntry < reachable ? blocks[k].maxEntry : reachable;
+        exit = blocks[k].entry;
+    }
+
+    for (k = 0; k < planner->count; k++)
+    {
+        double reachable = sqrt(blocks[k].entry * blocks[k].entry + 2.0 * blocks[k].accel * blocks[k].length);
+        double next = k + 1 < planner->count ? blocks[k + 1].entry : 0.0;
+        double seconds;
+
+        if (reachable < next)
+        {
+            next = reachable;
+            blocks[k + 1].entry = next;
+        }
+        seconds = BlockTime(&blocks[k], next);
+
+        if (blocks[k].ink)
+        {
+            planner->estimate->ink += seconds;
+        }
+        else
+        {
+            planner->estimate->travel += seconds;
+        }
+        if (AddPageTime(planner->estimate, blocks[k].page, seconds) != 0)
+        {
+            return (-1);
+        }
+    }
+
+    planner->count = 0;
+    planner->lastX = 0.0;
+    planner->lastY = 0.0;
+    return (0);
+}
+
+// Queues one move. (startX, startY) and (endX, endY) are its direction as it starts and as it ends.
+static int AddBlock (Planner *planner, double length, double nominal, double startX, double startY,
+                     double endX, double endY, int ink, int page)
+{
+    const PlannerSettings *settings = planner->settings;
+    PlannedBlock *block;
+    double maxEntry = 0.0;      // Entering from a standstill
+
+    if (planner->count == planner->capacity)
+    {
+        int newCapacity = planner->capacity ? planner->capacity * 2 : 256;
+        PlannedBlock *newBlocks = realloc(planner->blocks, (size_t)newCapacity * sizeof(PlannedBlock));
+
+        if (!newBlocks)
+        {
+            return (-1);
+        }
+        planner->blocks = newBlocks;
+        planner->capacity = newCapacity;
+    }
+
+    if (planner->count > 0)
+    {
+        // GRBL's junction deviation: the corner speed at which a circle of that deviation, tangent to
+        // both moves, would be taken at the acceleration limit
+        double cosTheta = -(planner->lastX * startX + planner->lastY * startY);
+
+        if (cosTheta < -0.999999)
+        {
+            maxEntry = HUGE_VAL;    // Straight on
+        }
+        else if (cosTheta <= 0.999999)
+        {
+            // Limited along the unit vector of the change in direction, as GRBL's junction_unit_vec
+            double junctionX = startX - planner->lastX, junctionY = startY - planner->lastY;
+            double junctionLength = sqrt(junctionX * junctionX + junctionY * junctionY);
+            double accel = LimitByAxis(junctionX / junctionLength, junctionY / junctionLength, settings->accelX, settings->accelY);
+            double sinHalf = sqrt(0.5 * (1.0 - cosTheta));
+
+            maxEntry = sqrt(accel * settings->junctionDeviation * sinHalf / (1.0 - sinHalf));
+        }
+        if (maxEntry > nominal) maxEntry = nominal;
+        if (maxEntry > planner->blocks[planner->count - 1].nominal) maxEntry = planner->blocks[planner->count - 1].nominal;
+    }
+
+    block = &planner->blocks[planner->count++];
+    block->length = length;
+    block->nominal = nominal;
+    block->accel = LimitByAxis(startX, startY, settings->accelX, settings->accelY);
+    block->maxEntry = maxEntry;
+    block->entry = 0.0;
+    block->ink = ink;
+    block->page = page;
+
+    planner->lastX = endX;
+    planner->lastY = endY;
+    planner->estimate->moves++;
+    if (ink)
+    {
+        planner->estimate->inkLength += length;
+    }
+    else
+    {
+        planner->estimate->travelLength += length;
+    }
+    return (0);
+}
+
+static int PlanRecord (Planner *planner, const MotionRecord *record, int32_t *x, int32_t *y)
+{
+    const PlannerSettings *settings = planner->settings;
+    double dx = MotionToMM(record->x - *x);
+    double dy = MotionToMM(record->y - *y);
+    int page = PageOf(planner, record->y);
+    int status = 0;
+
+    switch (record->op)
+    {
+        case MOTION_TRAVEL:
+        case MOTION_DRAW:
+        {
+            double length = sqrt(dx * dx + dy * dy);
+            double ux, uy, nominal;
+
+            if (length <= 0.0)
+            {
+                break;
+            }
+            ux = dx / length;
+            uy = dy / length;
+            nominal = LimitByAxis(ux, uy, settings->maxRateX, settings->maxRateY);
+            if (record->op == MOTION_DRAW && settings->drawFeed < nominal)
+            {
+                nominal = settings->drawFeed;
+            }
+            status = AddBlock(planner, length, nominal, ux, uy, ux, uy, record->op == MOTION_DRAW, page);
+            break;
+        }
+
+        case MOTION_ARC_CW:
+        case MOTION_ARC_CCW:
+        {
+            double turn = record->op == MOTION_ARC_CCW ? 1.0 : -1.0;
+            double fromX = -MotionToMM(record->i), fromY = -MotionToMM(record->j);     // Centre to start
+            double toX = fromX + dx, toY = fromY + dy;                                  // Centre to end
+            double radius = sqrt(fromX * fromX + fromY * fromY);
+            double sweep = atan2(fromX * toY - fromY * toX, fromX * toX + fromY * toY);
+            double toRadius = sqrt(toX * toX + toY * toY);
+            double accel, nominal;
+
+            if (radius <= 0.0 || toRadius <= 0.0)
+            {
+                break;
+            }
+            // Same convention as GRBL: a sweep that comes out the wrong way round goes the long way
+            if (turn > 0.0 && sweep <= 1e-9) sweep += FULL_TURN;
+            if (turn < 0.0 && sweep >= -1e-9) sweep -= FULL_TURN;
+
+            accel = settings->accelX < settings->accelY ? settings->accelX : settings->accelY;
+            nominal = settings->drawFeed;
+            if (sqrt(accel * radius) < nominal)
+            {
+                nominal = sqrt(accel * radius);     // Centripetal limit
+            }
+            if (settings->maxRateX < nominal) nominal = settings->maxRateX;
+            if (settings->maxRateY < nominal) nominal = settings->maxRateY;
+
+            // Tangents are the radius vectors turned a quarter in the direction of travel
+            status = AddBlock(planner, radius * fabs(sweep), nominal,
+                              -turn * fromY / radius, turn * fromX / radius,
+                              -turn * toY / toRadius, turn * toX / toRadius, 1, page);
+            break;
+        }
+
+        case MOTION_PEN_UP:
+        case MOTION_PEN_DOWN:
+            // GRBL waits for every move to finish before changing the spindle, so this is a full stop
+            status = FinishRun(planner);
+            planner->estimate->pen += settings->penTime;
+            planner->estimate->penChanges++;
+            if (status == 0)
+            {
+                status = AddPageTime(planner->estimate, PageOf(planner, *y), settings->penTime);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (IsMove(record->op))
+    {
+        *x = record->x;
+        *y = record->y;
+    }
+    return status;
+}
+
+
+int EstimateJob (const MotionBuffer *motion, const PlannerSettings *settings, JobEstimate *estimate)
+{
+    Planner planner = {0};
+    PenTracker pen;             // Adds the pen changes sending would add
+    MotionRecord steps[PEN_MAX_STEPS];
+    int32_t x = 0, y = 0;
+    int status = 0;
+    size_t i;
+
+    memset(estimate, 0, sizeof(JobEstimate));
+    planner.settings = settings;
+    planner.estimate = estimate;
+    StartPenTracker(&pen);
+
+    for (i = 0; i <= motion->count && status == 0; i++)
+    {
+        int stepCount = i < motion->count ? TrackPen(&pen, &motion->records[i], steps) : FinishPen(&pen, steps);
+        int k;
+
+        for (k = 0; k < stepCount && status == 0; k++)
+        {
+            status = PlanRecord(&planner, &steps[k], &x, &y);
+        }
+    }
+    if (status == 0)
+    {
+        status = FinishRun(&planner);
+    }
+
+    free(planner.blocks);
+    if (status != 0)
+    {
+        printf("Error: Unable to allocate memory for the time estimate.\n");
+    }
+    return status;
+}
+
+
+void PrintJobEstimate (const JobEstimate *estimate)
+{
+    double total = estimate->ink + estimate->travel + estimate->pen;
+    int page;
+
+    printf("Estimated drawing time: %.1f s (drawing %.1f s over %.1f mm, travel %.1f s over %.1f mm, pen %.1f s for %ld changes)\n",
+           total, estimate->ink, estimate->inkLength, estimate->travel, estimate->travelLength, estimate->pen, estimate->penChanges);
+    for (page = 0; page < estimate->pageCount && estimate->pageCount > 1; page++)
+    {
+        printf("  Page %d: %.1f s\n", page + 1, estimate->pages[page]);
+    }
+}
+
+void FreeJobEstimate (JobEstimate *estimate)
+{
+    free(estimate->pages);
+    estimate->pages = NULL;
+    estimate->pageCount = 0;
+}
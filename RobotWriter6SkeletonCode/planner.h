@@ -0,0 +1,54 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef PLANNER_H_INCLUDED
+#define PLANNER_H_INCLUDED
+
+
+#define PLANNER_ACCEL_X         250.0           /* mm/s^2, the controller's $120 setting */
+#define PLANNER_ACCEL_Y         250.0           /* mm/s^2, $121 */
+#define PLANNER_MAX_RATE_X      3000.0          /* mm/min, $110; G0 travels run at this rate */
+#define PLANNER_MAX_RATE_Y      3000.0          /* mm/min, $111 */
+#define PLANNER_JUNCTION_DEV    0.01            /* mm, $11 */
+#define PLANNER_DRAW_FEED       1000.0          /* mm/min, the F word sent before drawing starts */
+#define PLANNER_PEN_TIME        0.2             /* Seconds the robot waits for each S0/S1000 to finish */
+#define PLANNER_PAGE_HEIGHT     270.0           /* mm of writing per page, for the per-page times */
+
+typedef struct
+{
+    double accelX, accelY;                      // mm/s^2
+    double maxRateX, maxRateY;                  // mm/s
+    double junctionDeviation;                   // mm
+    double drawFeed;                            // mm/s
+    double penTime;                             // s
+    double pageHeight;                          // mm
+} PlannerSettings;
+
+typedef struct
+{
+    double ink;                                 // Seconds spent moving with the pen down
+    double travel;                              // Seconds spent moving with the pen up
+    double pen;                                 // Seconds spent lifting and lowering the pen
+    double inkLength, travelLength;             // mm
+    long moves;                                 // Moves planned
+    long penChanges;                            // S0/S1000 commands
+    double *pages;                              // Total seconds spent on each page
+    int pageCount;
+} JobEstimate;
+
+void DefaultPlannerSettings (PlannerSettings *settings);       // The PLANNER_ values above, in the units the planner uses
+
+// Estimates how long the robot takes to draw the job, planning it the way GRBL does: trapezoidal velocity
+// profiles, a junction speed at each corner from the junction deviation, and a full stop wherever the
+// pen changes state (GRBL finishes all motion before a spindle change). Arcs are one block with their
+// speed capped where the centripetal acceleration reaches the axis limit. The lookahead covers the whole
+// run between pen changes rather than GRBL's 16 blocks, which only matters for long runs of tiny moves.
+// Returns -1 if out of memory.
+int EstimateJob (const MotionBuffer *motion, const PlannerSettings *settings, JobEstimate *estimate);
+
+void PrintJobEstimate (const JobEstimate *estimate);
+void FreeJobEstimate (JobEstimate *estimate);
+
+#endif // PLANNER_H_INCLUDED
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "reorder.h"
+#include "thread.h"
+
+
+double PointDistance (int32_t ax, int32_t ay, int32_t bx, int32_t by)
+{
+    double dx = (double)bx - ax;
+    double dy = (double)by - ay;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+void StrokeEntry (const Stroke *stroke, int reversed, int32_t *x, int32_t *y)
+{
+    *x = reversed ? stroke->endX : stroke->startX;
+    *y = reversed ? stroke->endY : stroke->startY;
+}
+
+void StrokeExit (const Stroke *stroke, int reversed, int32_t *x, int32_t *y)
+{
+    *x = reversed ? stroke->startX : stroke->endX;
+    *y = reversed ? stroke->startY : stroke->endY;
+}
+
+
+int ExtractStrokes (const MotionRecord *records, size_t count, int32_t penX, int32_t penY, StrokeList *list)
+{
+    Stroke *current = NULL;     // Stroke being extended, NULL while the pen is up
+    size_t i;
+
+    list->count = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        const MotionRecord *record = &records[i];
+
+        if (record->op == MOTION_DRAW || IsArc(record->op))
+        {
+            if (!current)
+            {
+                if (list->count == list->capacity)
+                {
+                    int newCapacity = list->capacity ? list->capacity * 2 : 64;
+                    Stroke *newStrokes = realloc(list->strokes, (size_t)newCapacity * sizeof(Stroke));
+
+                    if (!newStrokes)
+                    {
+                        printf("Error: Unable to allocate memory for stroke ordering.\n");
+                        return (-1);
+                    }
+                    list->strokes = newStrokes;
+                    list->capacity = newCapacity;
+                }
+                current = &list->strokes[list->count++];
+                current->first = i;
+                current->count = 0;
+                current->startX = penX;
+                current->startY = penY;
+            }
+            current->count++;
+            current->endX = record->x;
+            current->endY = record->y;
+        }
+        else
+        {
+            current = NULL;     // A travel or pen command ends the stroke
+        }
+
+        if (IsMove(record->op))
+        {
+            penX = record->x;
+            penY = record->y;
+        }
+    }
+
+    return (0);
+}
+
+void FreeStrokeList (StrokeList *list)
+{
+    free(list->strokes);
+    list->strokes = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+
+double StrokeTravel (const Stroke *strokes, int count, int32_t x, int32_t y, const int *order, const char *reversed)
+{
+    double travel = 0.0;
+    int k;
+
+    for (k = 0; k < count; k++)
+    {
+        const Stroke *stroke = &strokes[order ? order[k] : k];
+        int backwards = reversed ? reversed[k] : 0;
+        int32_t entryX, entryY;
+
+        StrokeEntry(stroke, backwards, &entryX, &entryY);
+        travel += PointDistance(x, y, entryX, entryY);
+        StrokeExit(stroke, backwards, &x, &y);
+    }
+
+    return (travel);
+}
+
+
+int TwoOptPass (const Stroke *strokes, int *order, char *reversed, const StrokeRange *range, int window, double deadline)
+{
+    int improved = 0;
+    int i, j;
+
+    for (i = range->from; i < range->to; i++)
+    {
+        int32_t beforeX = range->beforeX, beforeY = range->beforeY;     // Where the pen is before stroke i
+        int32_t entryX, entryY;
+        int last = window > 0 && i + window < range->to ? i + window : range->to - 1;
+
+        if (WallClockMs() > deadline)
+        {
+            break;
+        }
+
+        if (i > range->from)
+        {
+            StrokeExit(&strokes[order[i - 1]], reversed[i - 1], &beforeX, &beforeY);
+        }
+        StrokeEntry(&strokes[order[i]], reversed[i], &entryX, &entryY);
+
+        for (j = i; j <= last; j++)
+        {
+            int32_t exitX, exitY, nextX, nextY;
+            int hasNext = 1;
+            double before, after;
+
+            // Reversing the block i..j only changes the two travels at its ends
+            StrokeExit(&strokes[order[j]], reversed[j], &exitX, &exitY);
+            if (j + 1 < range->to)
+            {
+                StrokeEntry(&strokes[order[j + 1]], reversed[j + 1], &nextX, &nextY);
+            }
+            else if (range->hasAfter)
+            {
+                nextX = range->afterX;
+                nextY = range->afterY;
+            }
+            else
+            {
+                hasNext = 0;
+            }
+
+            before = PointDistance(beforeX, beforeY, entryX, entryY);
+            after = PointDistance(beforeX, beforeY, exitX, exitY);
+            if (hasNext)
+            {
+                before += PointDistance(exitX, exitY, nextX, nextY);
+                after += PointDistance(entryX, entryY, nextX, nextY);
+            }
+
+            if (after < before - 0.5)  // Half a micrometre, so rounding noise cannot make it loop
+            {
+                int a, b;
+
+                for (a = i, b = j; a < b; a++, b--)
+                {
+                    int swapOrder = order[a];
+                    char swapReversed = reversed[a];
+
+                    order[a] = order[b];
+                    reversed[a] = reversed[b];
+                    order[b] = swapOrder;
+                    reversed[b] = swapReversed;
+                }
+                for (a = i; a <= j; a++)
+                {
+                    reversed[a] = !reversed[a];
+                }
+                StrokeEntry(&strokes[order[i]], reversed[i], &entryX, &entryY);
+                improved = 1;
+            }
+        }
+    }
+
+    return (improved);
+}
+
+double RefineStrokeOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, double budgetMs)
+{
+    StrokeRange range = {0};
+    double deadline = WallClockMs() + budgetMs;
+
+    range.to = count;
+    range.beforeX = x;
+    range.beforeY = y;
+    while (WallClockMs() < deadline)
+    {
+        if (!TwoOptPass(strokes, order, reversed, &range, 0, deadline))
+        {
+            break;      // No reversal helps any more
+        }
+    }
+
+    return StrokeTravel(strokes, count, x, y, order, reversed);
+}
+
+
+double OrderStrokes (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, double budgetMs)
+{
+    char *used;
+    int32_t penX = x, penY = y;
+    int k, s;
+
+    if (count <= 0)
+    {
+        return (0.0);
+    }
+
+    used = calloc((size_t)count, 1);
+    if (!used)
+    {
+        // Keep the layout order
+        for (k = 0; k < count; k++)
+        {
+            order[k] = k;
+            reversed[k] = 0;
+        }
+        return StrokeTravel(strokes, count, x, y, order, reversed);
+    }
+
+    // Nearest neighbour: always go to the closest free stroke end, drawing from whichever end is nearer
+    for (k = 0; k < count; k++)
+    {
+        int best = -1;
+        int bestReversed = 0;
+        double bestDistance = 0.0;
+
+        for (s = 0; s < count; s++)
+        {
+            double forwards, backwards;
+
+            if (used[s])
+            {
+                continue;
+            }
+            forwards = PointDistance(penX, penY, strokes[s].startX, strokes[s].startY);
+            backwards = PointDistance(penX, penY, strokes[s].endX, strokes[s].endY);
+            if (best < 0 || forwards < bestDistance)
+            {
+                best = s;
+                bestReversed = 0;
+                bestDistance = forwards;
+            }
+            if (backwards < bestDistance)
+            {
+                best = s;
+                bestReversed = 1;
+                bestDistance = backwards;
+            }
+        }
+
+        used[best] = 1;
+        order[k] = best;
+        reversed[k] = (char)bestReversed;
+        StrokeExit(&strokes[best], bestReversed, &penX, &penY);
+    }
+
+    free(used);
+
+    return RefineStrokeOrder(strokes, count, x, y, order, reversed, budgetMs);
+}
+
+
+int AppendStroke (MotionBuffer *out, const MotionRecord *records, const Stroke *stroke, int reversed)
+{
+    int k;
+
+    if (!reversed)
+    {
+        if (AppendMotion(out, MOTION_TRAVEL, stroke->startX, stroke->startY) != 0)
+        {
+            return (-1);
+        }
+        for (k = 0; k < stroke->count; k++)
+        {
+            if (AppendMotionRecord(out, &records[stroke->first + (size_t)k]) != 0)
+            {
+                return (-1);
+            }
+        }
+        return (0);
+    }
+
+    if (AppendMotion(out, MOTION_TRAVEL, stroke->endX, stroke->endY) != 0)
+    {
+        return (-1);
+    }
+
+    // Walk the moves backwards: each one now ends where the one before it ended
+    for (k = stroke->count - 1; k >= 0; k--)
+    {
+        const MotionRecord *record = &records[stroke->first + (size_t)k];
+        MotionRecord step = *record;
+
+        step.x = k > 0 ? records[stroke->first + (size_t)k - 1].x : stroke->startX;
+        step.y = k > 0 ? records[stroke->first + (size_t)k - 1].y : stroke->startY;
+
+        if (IsArc(record->op))
+        {
+            // Same circle travelled the other way: centre offset is now taken from the old end point
+            int32_t centreX = step.x + record->i;
+            int32_t centreY = step.y + record->j;
+
+            step.op = record->op == MOTION_ARC_CW ? MOTION_ARC_CCW : MOTION_ARC_CW;
+            step.i = (int16_t)(centreX - record->x);
+            step.j = (int16_t)(centreY - record->y);
+        }
+
+        if (AppendMotionRecord(out, &step) != 0)
+        {
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+
+int ReorderStrokesByLine (MotionBuffer *motion)
+{
+    MotionBuffer out = {0};
+    StrokeList list = {0};
+    int *order = NULL;
+    char *reversed = NULL;
+    int capacity = 0;
+    int32_t penX = 0, penY = 0;     // The job starts at the origin
+    double totalBefore = 0.0, totalAfter = 0.0;
+    size_t start = 0;
+    int line = 0;
+    int failed = 0;
+
+    while (start < motion->count && !failed)
+    {
+        size_t end = start;
+        double before, after;
+        int k;
+
+        // A line runs from its marker up to the next one
+        if (motion->records[end].op == MOTION_LINE)
+        {
+            if (AppendMotionRecord(&out, &motion->records[end]) != 0)
+            {
+                failed = 1;
+                break;
+            }
+            end++;
+            start++;
+        }
+        while (end < motion->count && motion->records[end].op != MOTION_LINE)
+        {
+            end++;
+        }
+
+        if (ExtractStrokes(&motion->records[start], end - start, penX, penY, &list) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        if (list.count > capacity)
+        {
+            int *newOrder = realloc(order, (size_t)list.count * sizeof(int));
+            char *newReversed = newOrder ? realloc(reversed, (size_t)list.count) : NULL;
+
+            if (newOrder) order = newOrder;
+            if (!newReversed)
+            {
+                printf("Error: Unable to allocate memory for stroke ordering.\n");
+                failed = 1;
+                break;
+            }
+            reversed = newReversed;
+            capacity = list.count;
+        }
+
+        before = StrokeTravel(list.strokes, list.count, penX, penY, NULL, NULL);
+        after = OrderStrokes(list.strokes, list.count, penX, penY, order, reversed, REORDER_TIME_BUDGET_MS);
+        if (after > before)
+        {
+            // Only happens if the time budget ran out early; the layout order is better, so keep it
+            for (k = 0; k < list.count; k++)
+            {
+                order[k] = k;
+                reversed[k] = 0;
+            }
+            after = before;
+        }
+
+        for (k = 0; k < list.count; k++)
+        {
+            // Strokes are relative to this line, so offset them back into the whole buffer
+            Stroke stroke = list.strokes[order[k]];
+
+            stroke.first += start;
+            if (AppendStroke(&out, motion->records, &stroke, reversed[k]) != 0)
+            {
+                failed = 1;
+                break;
+            }
+            StrokeExit(&stroke, reversed[k], &penX, &penY);
+        }
+
+        if (list.count > 0)
+        {
+            printf("Line %d: %d strokes, travel %.1f -> %.1f mm, about %.1f s saved\n", line, list.count,
+                   before / MOTION_UNITS_PER_MM, after / MOTION_UNITS_PER_MM,
+                   (before - after) / MOTION_UNITS_PER_MM / (REORDER_TRAVEL_FEED / 60.0));
+        }
+        totalBefore += before;
+        totalAfter += after;
+        line++;
+        start = end;
+    }
+
+    FreeStrokeList(&list);
+    free(order);
+    free(reversed);
+
+    if (failed)
+    {
+        FreeMotion(&out);   // Leave the job as it was laid out
+        return (-1);
+    }
+
+    printf("Stroke ordering: travel %.1f -> %.1f mm over %d lines\n",
+           totalBefore / MOTION_UNITS_PER_MM, totalAfter / MOTION_UNITS_PER_MM, line);
+
+    FreeMotion(motion);
+    *motion = out;
+    return (0);
+}
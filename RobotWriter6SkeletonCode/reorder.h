@@ -0,0 +1,72 @@
+#include <stdio.h>
+
+#include "motion.h"
+
+
+#ifndef REORDER_H_INCLUDED
+#define REORDER_H_INCLUDED
+
+
+#define REORDER_TIME_BUDGET_MS  20.0            /* Time 2-opt may spend improving one line */
+#define REORDER_TRAVEL_FEED     1000.0          /* Pen up travel speed in mm/min used for time estimates (F1000) */
+
+typedef struct
+{
+    size_t first;                               // Index of the first pen down move of the stroke
+    int count;                                  // Number of pen down moves, draws and arcs
+    int32_t startX;                             // Where the pen goes down
+    int32_t startY;
+    int32_t endX;                               // Where the pen comes up
+    int32_t endY;
+} Stroke;                                       // One pen down polyline, which can be drawn in either direction
+
+typedef struct
+{
+    Stroke *strokes;
+    int count;
+    int capacity;
+} StrokeList;
+
+typedef struct
+{
+    int from, to;                               // Positions of the order a 2-opt pass may change
+    int32_t beforeX, beforeY;                   // Where the pen is before position from
+    int hasAfter;                               // 1 if a stroke that stays put follows position to - 1
+    int32_t afterX, afterY;                     // Where the pen goes down for that stroke
+} StrokeRange;
+
+// Splits records[0..count) into strokes. (penX, penY) is where the pen is before the first record.
+// Pen up travels are dropped, AppendStroke puts back the one travel each stroke needs. Returns -1 if out of memory.
+int ExtractStrokes (const MotionRecord *records, size_t count, int32_t penX, int32_t penY, StrokeList *list);
+void FreeStrokeList (StrokeList *list);
+
+double PointDistance (int32_t ax, int32_t ay, int32_t bx, int32_t by);
+
+// Where the pen goes down and comes up for a stroke drawn forwards or backwards
+void StrokeEntry (const Stroke *stroke, int reversed, int32_t *x, int32_t *y);
+void StrokeExit (const Stroke *stroke, int reversed, int32_t *x, int32_t *y);
+
+// Pen up travel from (x, y) through the strokes in the given order, in micrometres
+double StrokeTravel (const Stroke *strokes, int count, int32_t x, int32_t y, const int *order, const char *reversed);
+
+// Orders strokes with nearest neighbour from (x, y), then refines with 2-opt until no move helps or
+// budgetMs runs out. order[k] is the k-th stroke to draw and reversed[k] says whether it is drawn backwards.
+// Returns the resulting travel in micrometres.
+double OrderStrokes (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, double budgetMs);
+
+// One 2-opt sweep over the positions in range: each block of at most window strokes (0 for no limit) that
+// makes less travel drawn backwards is reversed. Only range's positions are written, so passes over ranges that
+// do not overlap can run side by side. Stops at deadline, a WallClockMs() value. Returns 1 if anything moved.
+int TwoOptPass (const Stroke *strokes, int *order, char *reversed, const StrokeRange *range, int window, double deadline);
+
+// 2-opt on an existing order. Reversing a block of strokes also reverses the direction each one is drawn in.
+// Returns the travel after refinement.
+double RefineStrokeOrder (const Stroke *strokes, int count, int32_t x, int32_t y, int *order, char *reversed, double budgetMs);
+
+// Appends a travel to the stroke's first point followed by its moves, backwards if reversed is set
+int AppendStroke (MotionBuffer *out, const MotionRecord *records, const Stroke *stroke, int reversed);
+
+// Reorders the strokes of each text line (the records between MOTION_LINE markers) and prints the gain per line
+int ReorderStrokesByLine (MotionBuffer *motion);
+
+#endif // REORDER_H_INCLUDED
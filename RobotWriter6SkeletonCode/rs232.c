@@ -37,6 +37,7 @@
 #if defined(__linux__) || defined(__FreeBSD__)   /* Linux & FreeBSD */
 
 #define RS232_PORTNR  38
+#define RS232_MAX_PIECES  16    /* most buffers RS232_SendBufs gathers into one write */
 
 
 int Cport[RS232_PORTNR],
@@ -324,6 +325,43 @@ int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 }
 
 
+int RS232_PollComportTimeout(int comport_number, unsigned char *buf, int size, int timeout_ms)  /* sleeps until bytes arrive, 0 if none within timeout_ms */
+{
+    struct pollfd port;
+    int n;
+
+    port.fd = Cport[comport_number];
+    port.events = POLLIN;
+    port.revents = 0;
+
+    n = poll(&port, 1, timeout_ms);
+
+    if(n < 0)
+    {
+        if(errno == EINTR)
+            return 0;   /* the caller works out how much of its time is left and waits again */
+
+        return(-1);
+    }
+
+    if(n == 0)
+        return 0;
+
+    if(!(port.revents & POLLIN))
+        return(-1);     /* POLLERR, POLLHUP or POLLNVAL: the adapter has gone */
+
+    n = read(Cport[comport_number], buf, size);
+
+    if(n == 0)
+        return(-1);     /* readable but end of file: the port was closed or unplugged, often with POLLHUP alongside */
+
+    if(n < 0 && errno == EAGAIN)
+        return 0;
+
+    return(n);
+}
+
+
 int RS232_SendByte(int comport_number, unsigned char byte)
 {
     int n = write(Cport[comport_number], &byte, 1);
@@ -362,6 +400,66 @@ int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
 }
 
 
+int RS232_SendBufs(int comport_number, unsigned char **bufs, const int *sizes, int count)  /* several buffers in one writev() */
+{
+    struct iovec pieces[RS232_MAX_PIECES];
+    int i, n;
+
+    if(count > RS232_MAX_PIECES)
+        count = RS232_MAX_PIECES;
+
+    for(i=0; i < count; i++)
+    {
+        pieces[i].iov_base = bufs[i];
+        pieces[i].iov_len = sizes[i];
+    }
+
+    n = writev(Cport[comport_number], pieces, count);
+    if(n < 0)
+    {
+        if(errno == EAGAIN || errno == EINTR)
+        {
+            return 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return(n);
+}
+
+
+int RS232_WaitForSendSpace(int comport_number, int timeout_ms)  /* 1 once the port takes more, 0 if it does not within timeout_ms */
+{
+    struct pollfd port;
+    int n;
+
+    port.fd = Cport[comport_number];
+    port.events = POLLOUT;
+    port.revents = 0;
+
+    n = poll(&port, 1, timeout_ms);
+
+    if(n < 0)
+    {
+        if(errno == EINTR)
+            return 0;
+
+        return(-1);
+    }
+
+    if(n == 0)
+        return 0;
+
+    if(!(port.revents & POLLOUT))
+        return(-1);
+
+    return(1);
+}
+
+
 void RS232_CloseComport(int comport_number)
 {
     int status;
@@ -740,6 +838,39 @@ int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 }
 
 
+int RS232_PollComportTimeout(int comport_number, unsigned char *buf, int size, int timeout_ms)  /* sleeps until bytes arrive, 0 if none within timeout_ms */
+{
+    int n = 0;
+
+    if(timeout_ms <= 0)
+        return RS232_PollComport(comport_number, buf, size);
+
+    COMMTIMEOUTS Cptimeouts;
+
+    /* with both of these at MAXDWORD, ReadFile returns as soon as a byte arrives, or after the constant */
+    Cptimeouts.ReadIntervalTimeout         = MAXDWORD;
+    Cptimeouts.ReadTotalTimeoutMultiplier  = MAXDWORD;
+    Cptimeouts.ReadTotalTimeoutConstant    = timeout_ms;
+    Cptimeouts.WriteTotalTimeoutMultiplier = 0;
+    Cptimeouts.WriteTotalTimeoutConstant   = 0;
+
+    if(!SetCommTimeouts(Cport[comport_number], &Cptimeouts))
+        return(-1);
+
+    if(!ReadFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL))
+        n = -1;
+
+    /* back to returning at once, which RS232_PollComport relies on */
+    Cptimeouts.ReadTotalTimeoutMultiplier  = 0;
+    Cptimeouts.ReadTotalTimeoutConstant    = 0;
+
+    if(!SetCommTimeouts(Cport[comport_number], &Cptimeouts))
+        return(-1);
+
+    return(n);
+}
+
+
 int RS232_SendByte(int comport_number, unsigned char byte)
 {
     int n;
@@ -766,6 +897,34 @@ int RS232_SendBuf(int comport_number, unsigned char *buf, int size)
 }
 
 
+int RS232_SendBufs(int comport_number, unsigned char **bufs, const int *sizes, int count)  /* no writev() here, so one WriteFile each */
+{
+    int i, n, total = 0;
+
+    for(i=0; i < count; i++)
+    {
+        n = RS232_SendBuf(comport_number, bufs[i], sizes[i]);
+        if(n < 0)
+            return(total > 0 ? total : -1);
+
+        total += n;
+        if(n < sizes[i])
+            break;
+    }
+
+    return(total);
+}
+
+
+int RS232_WaitForSendSpace(int comport_number, int timeout_ms)  /* WriteFile blocks until it is done, so there is always room */
+{
+    (void)comport_number;
+    (void)timeout_ms;
+
+    return(1);
+}
+
+
 void RS232_CloseComport(int comport_number)
 {
     CloseHandle(Cport[comport_number]);
@@ -865,8 +1024,19 @@ void RS232_flushRXTX(int comport_number)
 
 void RS232_cputs(int comport_number, const char *text)  /* sends a string to serial port */
 {
-    while(*text != 0)
-        RS232_SendByte(comport_number, *(text++));
+    int length = strlen(text), n;
+
+    while(length > 0)   /* the whole string in one write, not one per byte; carry on after a partial write */
+    {
+        n = RS232_SendBuf(comport_number, (unsigned char *)text, length);
+        if(n < 0)
+            return;
+
+        text += n;
+        length -= n;
+        if(length > 0 && RS232_WaitForSendSpace(comport_number, 1000) <= 0)
+            return;
+    }
 }
 
 
@@ -53,6 +53,8 @@ extern "C" {
 #include <limits.h>
 #include <sys/file.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #else
 
@@ -62,8 +64,11 @@ extern "C" {
 
 int RS232_OpenComport(int, int, const char *);
 int RS232_PollComport(int, unsigned char *, int);
+int RS232_PollComportTimeout(int, unsigned char *, int, int);
 int RS232_SendByte(int, unsigned char);
 int RS232_SendBuf(int, unsigned char *, int);
+int RS232_SendBufs(int, unsigned char **, const int *, int);
+int RS232_WaitForSendSpace(int, int);
 void RS232_CloseComport(int);
 void RS232_cputs(int, const char *);
 int RS232_IsDCDEnabled(int);
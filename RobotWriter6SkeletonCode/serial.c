@@ -2,7 +2,9 @@
 #include <stdlib.h>
 
 #include "serial.h"
+#include "link.h"
 #include "rs232.h"
+#include "thread.h"
 
 
 //#define Serial_Mode
@@ -25,13 +27,16 @@ int CanRS232PortBeOpened ( void )
 // Function to close the COM port
 void CloseRS232Port (void)
 {
+    FlushBytes();
+    PrintSerialStats();
     RS232_CloseComport(cport_nr);
 }
 
 // Write text out via the serial port
 int PrintBuffer (char *buffer)
 {
-    RS232_cputs(cport_nr, buffer);
+    SendBytes(buffer, (int)strlen(buffer));
+    FlushBytes();       // The caller waits for the reply next, so the line goes in one write now
     printf("sent: %s\n", buffer);
 
     return (0);
@@ -39,91 +44,260 @@ int PrintBuffer (char *buffer)
 }
 
 
-int WaitForDollar (void)
+// Milliseconds left until deadline, rounded up so a wait never ends early
+static int RemainingMs (double deadline)
 {
+    double remaining = deadline - WallClockMs();
 
+    return remaining > 0.0 ? (int)(remaining + 0.999) : 0;
+}
 
-    int i, n;
 
-    unsigned char buf[4096];
+// Waits for GRBL's start-up banner ("Grbl 1.1h ['$' for help]") or an ok, sleeping in the port until bytes arrive
+int WaitForDollar (void)
+{
+    double deadline = WallClockMs() + wake_timeout_ms;
+    char reply[256];
+    int n;
 
-    while(1)
+    while ((n = ReadReply(reply, sizeof(reply), RemainingMs(deadline))) > 0)
     {
-        printf (".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
-
-        if(n > 0)
+        printf("received: %s\n", reply);
+        if (strchr(reply, '$'))
+        {
+            printf("\nSaw the Dollar");
+            return (0);
+        }
+        if (strncmp(reply, "ok", 2) == 0)
         {
-            printf ("RCVD: N = %d ", n);
-            buf[n] = 0;   /* always put a "null" at the end of a string! */
+            return (0);
+        }
+    }
 
-            for(i=0; i < n; i++)
-            {
-                if(buf[i] == '$')  /* replace unreadable control-codes by dots */
-                {
-                    printf("received %i bytes: %s \n", n, (char *)buf);
-                    printf("\nSaw the Dollar");
-                    return 0;
-                }
-            }
+    if (n == 0)
+    {
+        printf("Error: The robot did not answer within %d ms of waking it\n", wake_timeout_ms);
+    }
+    else if (n == LINK_REPLY_TOO_LONG)
+    {
+        printf("Error: The robot sent a line longer than %d bytes while waking it, which is not its banner\n", reply_buffer_size);
+    }
+    else
+    {
+        printf("Error: Lost the connection to the robot while waking it\n");
+    }
+    return (-1);
+}
 
-            printf("received %i bytes: %s \n", n, (char *)buf);
 
+// Waits for the robot to answer the line just sent. An error is an answer too, as no ok follows it, so it returns 1.
+int WaitForReply (void)
+{
+    double deadline = WallClockMs() + reply_timeout_ms;
+    char reply[256];
+    int n;
 
-            if ( (buf[0] == 'o') && (buf[1] == 'k') )
-                return 0;
+    while ((n = ReadReply(reply, sizeof(reply), RemainingMs(deadline))) > 0)
+    {
+        printf("received: %s\n", reply);
+        if (strncmp(reply, "ok", 2) == 0)
+        {
+            return (0);
         }
+        if (strncmp(reply, "error", 5) == 0)
+        {
+            return (1);
+        }
+    }
 
-
-        Sleep(100);
-
+    if (n == 0)
+    {
+        printf("Error: No reply from the robot within %d ms\n", reply_timeout_ms);
+    }
+    else if (n == LINK_REPLY_TOO_LONG)
+    {
+        printf("Error: The robot answered with a line longer than %d bytes, which could not be read\n", reply_buffer_size);
+    }
+    else
+    {
+        printf("Error: Lost the connection to the robot while waiting for a reply\n");
     }
+    return (-1);
+}
 
-    return(0);
 
-}
+static char replyBuffer[reply_buffer_size];     // Bytes received but not yet handed out as a reply line
+static int replyLength = 0;
+static int replyDiscarding = 0;    // Set while the rest of an over-long reply is still to be skipped
 
+static char txQueue[tx_queue_size];    // Bytes queued for the port but not yet taken by it, a ring starting at txStart
+static int txStart = 0, txLength = 0;
+static long txCommands = 0, txWrites = 0, txPartial = 0, txWaits = 0;
+static long long txBytes = 0;
 
-int WaitForReply (void)
+// One write for everything queued; when the ring has wrapped, its two halves go together through writev
+static int WriteQueued (void)
 {
+    unsigned char *pieces[2];
+    int sizes[2], count = 1, n;
 
+    pieces[0] = (unsigned char *)&txQueue[txStart];
+    sizes[0] = txStart + txLength > tx_queue_size ? tx_queue_size - txStart : txLength;
+    if (sizes[0] < txLength)
+    {
+        pieces[1] = (unsigned char *)txQueue;
+        sizes[1] = txLength - sizes[0];
+        count = 2;
+    }
 
-    int i, n;
+    n = RS232_SendBufs(cport_nr, pieces, sizes, count);
+    txWrites++;
+    if (n > 0)
+    {
+        txStart = (txStart + n) % tx_queue_size;
+        txLength -= n;
+        txBytes += n;
+    }
+    return n;
+}
 
-    unsigned char buf[4096];
+int FlushBytes (void)
+{
+    double deadline = WallClockMs() + reply_timeout_ms;
 
-    while(1)
+    while (txLength > 0)
     {
-        printf (".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        int n = WriteQueued();
 
-        if(n > 0)
+        if (n < 0)
         {
-            printf ("RCVD: N = %d ", n);
-            buf[n] = 0;   /* always put a "null" at the end of a string! */
-
-            for(i=0; i < n; i++)
+            printf("Error: Could not write to the COM port\n");
+            return (-1);
+        }
+        if (txLength > 0)
+        {
+            // The driver's buffer is full (a partial write or EAGAIN): sleep until it takes more
+            txPartial += n > 0;
+            txWaits++;
+            if (RS232_WaitForSendSpace(cport_nr, RemainingMs(deadline)) <= 0)
             {
-                if(buf[i] < 32)  /* replace unreadable control-codes by dots */
-                {
-                    buf[i] = '.';
-                }
+                printf("Error: The COM port took nothing for %d ms, %d bytes not sent\n", reply_timeout_ms, txLength);
+                return (-1);
             }
+        }
+    }
+    return (0);
+}
 
-            printf("received %i bytes: %s\n", n, (char *)buf);
-
+// Queues the bytes; they go out in one batch when a reply is next waited for, or sooner if the queue fills
+int SendBytes (const char *bytes, int length)
+{
+    while (length > 0)
+    {
+        int tail = (txStart + txLength) % tx_queue_size;
+        int room = tx_queue_size - txLength;
+        int chunk = length < room ? length : room;
+        int first = chunk < tx_queue_size - tail ? chunk : tx_queue_size - tail;
 
-            if ( (buf[0] == 'o') && (buf[1] == 'k') )
-                return 0;
+        if (chunk == 0)
+        {
+            if (FlushBytes() != 0)
+            {
+                return (-1);
+            }
+            continue;
+        }
+        memcpy(&txQueue[tail], bytes, (size_t)first);
+        memcpy(txQueue, bytes + first, (size_t)(chunk - first));
+        for (int i = 0; i < chunk; i++)
+        {
+            txCommands += bytes[i] == '\n';
         }
+        txLength += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+    return (0);
+}
 
+void PrintSerialStats (void)
+{
+    printf("Serial: %ld commands, %lld bytes in %ld write calls (%.2f per command), %ld partial writes, %ld waits for the port\n",
+           txCommands, txBytes, txWrites, txCommands > 0 ? (double)txWrites / txCommands : 0.0, txPartial, txWaits);
+}
 
-        Sleep(100);
+int ReadReply (char *reply, int size, int timeoutMs)
+{
+    double deadline = WallClockMs() + timeoutMs;
 
+    // Whatever was queued has to reach the robot before it can be answered
+    if (FlushBytes() != 0)
+    {
+        return (-1);
     }
 
-    return(0);
+    while (1)
+    {
+        char *newline = memchr(replyBuffer, '\n', (size_t)replyLength);
+        int n, remaining;
 
+        if (replyDiscarding)
+        {
+            // The rest of a line too long to hold: dropped up to its newline
+            if (newline)
+            {
+                replyLength -= (int)(newline + 1 - replyBuffer);
+                memmove(replyBuffer, newline + 1, (size_t)replyLength);
+                replyDiscarding = 0;
+                continue;
+            }
+            replyLength = 0;
+        }
+        if (!newline && replyLength == (int)sizeof(replyBuffer))
+        {
+            replyLength = 0;
+            replyDiscarding = 1;
+            return LINK_REPLY_TOO_LONG;
+        }
+        if (newline)
+        {
+            int length = (int)(newline - replyBuffer);
+            int kept = 0;
+
+            for (int i = 0; i < length && kept < size - 1; i++)
+            {
+                if (replyBuffer[i] != '\r')
+                {
+                    reply[kept++] = replyBuffer[i];
+                }
+            }
+            reply[kept] = 0;
+            replyLength -= length + 1;
+            memmove(replyBuffer, newline + 1, (size_t)replyLength);
+            if (kept > 0)
+            {
+                return kept;
+            }
+            continue;       // Blank line
+        }
+
+        // Sleeps in the port until bytes arrive, so a reply is picked up as soon as it is there
+        remaining = RemainingMs(deadline);
+        n = RS232_PollComportTimeout(cport_nr, (unsigned char *)&replyBuffer[replyLength], (int)sizeof(replyBuffer) - replyLength, remaining);
+        if (n > 0)
+        {
+            replyLength += n;
+            continue;
+        }
+        if (n < 0)
+        {
+            return (-1);
+        }
+        if (remaining == 0)
+        {
+            return (0);
+        }
+    }
 }
 
 // Error was here - this should be 'ELSE' not 'ELSEIF'
@@ -165,6 +339,31 @@ int WaitForDollar (void)
     return (0);
 }
 
+int SendBytes (const char *bytes, int length)
+{
+    printf("%.*s", length, bytes);
+    return (0);
+}
+
+int FlushBytes (void)
+{
+    return (0);
+}
+
+void PrintSerialStats (void)
+{
+    return;
+}
+
+// Like WaitForReply: step through by pressing enter, every line is taken as accepted
+int ReadReply (char *reply, int size, int timeoutMs)
+{
+    (void)timeoutMs;
+    getchar();
+    snprintf(reply, (size_t)size, "ok");
+    return (int)strlen(reply);
+}
+
 
 #endif // SM
 
@@ -8,11 +8,19 @@
 
 #define cport_nr    12                 /* COM number minus 1 */
 #define bdrate      115200              /* 115200  */
+#define reply_timeout_ms    30000       /* Longest wait for the robot to answer a line; a full planner holds the answer back for a whole move */
+#define wake_timeout_ms     10000       /* Longest wait for the start-up banner; GRBL resets when the port opens */
+#define tx_queue_size       4096        /* Bytes SendBytes can queue before it has to write them out */
+#define reply_buffer_size   4096        /* Longest reply line ReadReply can take in; longer ones are thrown away */
 
 int PrintBuffer (char *buffer);                 //JIB: Needed to match the function
-int WaitForReply (void);                        // Wit for OK function
-int WaitForDollar (void);                       // Wait for '$' function (for startup)
+int WaitForReply (void);                        // Wit for OK function; 1 on an error reply, -1 if nothing came within reply_timeout_ms
+int WaitForDollar (void);                       // Wait for '$' function (for startup); -1 after wake_timeout_ms
+int SendBytes (const char *bytes, int length);  // Queues raw bytes, no logging; returns -1 if the queue was full and could not be written
+int FlushBytes (void);                          // Writes out everything queued, waiting for the port as needed; -1 if it will not take it
+int ReadReply (char *reply, int size, int timeoutMs);   // Next reply line, 0 if none within timeoutMs, -1 if the port failed, LINK_REPLY_TOO_LONG if the line overflowed (see link.h)
 int CanRS232PortBeOpened ( void );              // Port open check
-void CloseRS232Port (void);
+void CloseRS232Port (void);                     // Flushes the queue and prints the write statistics first
+void PrintSerialStats (void);                   // Commands, bytes and write calls so far
 
 #endif // SERIAL_H_INCLUDED
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "settle.h"
+#include "encoder.h"
+
+
+static void SendCardStep (const SinkList *sinks, int op, double x, double y, int milliseconds)
+{
+    MotionRecord record;
+    char line[ENCODER_MAX_LINE];
+    int length;
+
+    record.op = (uint8_t)op;
+    record.x = MotionFromMM(x);
+    record.y = MotionFromMM(y);
+    record.i = (int16_t)milliseconds;
+    record.j = 0;
+    length = EncodeMotionRecord(&record, line);
+    EmitCommand(sinks, line, (size_t)length);
+}
+
+void DrawSettleCalibration (const SinkList *sinks)
+{
+    int mark;
+
+    printf("Pen settle calibration: %d marks from the left, %d ms to %d ms of dwell in steps of %d ms\n",
+           SETTLE_MARKS, SettleForMark(1), SettleForMark(SETTLE_MARKS), SETTLE_STEP_MS);
+
+    for (mark = 1; mark <= SETTLE_MARKS; mark++)
+    {
+        double x = (mark - 1) * SETTLE_MARK_PITCH_MM;
+        int dwell = SettleForMark(mark);
+
+        // Starts with the pen up, as the preamble leaves it
+        SendCardStep(sinks, MOTION_TRAVEL, x, SETTLE_CARD_Y_MM, 0);
+        SendCardStep(sinks, MOTION_PEN_DOWN, x, SETTLE_CARD_Y_MM, 0);
+        if (dwell > 0)
+        {
+            SendCardStep(sinks, MOTION_DWELL, x, SETTLE_CARD_Y_MM, dwell);
+        }
+        SendCardStep(sinks, MOTION_DRAW, x + SETTLE_DASH_MM, SETTLE_CARD_Y_MM, 0);
+        SendCardStep(sinks, MOTION_PEN_UP, x + SETTLE_DASH_MM, SETTLE_CARD_Y_MM, 0);
+        if (dwell > 0)
+        {
+            SendCardStep(sinks, MOTION_DWELL, x + SETTLE_DASH_MM, SETTLE_CARD_Y_MM, dwell);
+        }
+    }
+    SendCardStep(sinks, MOTION_TRAVEL, 0.0, 0.0, 0);
+}
+
+int SettleForMark (int mark)
+{
+    if (mark < 1 || mark > SETTLE_MARKS)
+    {
+        return (-1);
+    }
+    return (mark - 1) * SETTLE_STEP_MS;
+}
+
+
+int LoadPenSettle (void)
+{
+    FILE *file = fopen(SETTLE_FILE, "r");
+    int milliseconds;
+
+    if (!file)
+    {
+        return SETTLE_DEFAULT_MS;       // Not calibrated yet
+    }
+    if (fscanf(file, "%d", &milliseconds) != 1 || milliseconds < 0 || milliseconds > SETTLE_MAX_MS)
+    {
+        printf("Warning: %s does not hold a settle time from 0 to %d ms, using %d ms\n", SETTLE_FILE, SETTLE_MAX_MS, SETTLE_DEFAULT_MS);
+        milliseconds = SETTLE_DEFAULT_MS;
+    }
+    fclose(file);
+    return (milliseconds);
+}
+
+int SavePenSettle (int milliseconds)
+{
+    FILE *file;
+
+    if (milliseconds < 0 || milliseconds > SETTLE_MAX_MS)
+    {
+        printf("Error: A settle time must be from 0 to %d ms\n", SETTLE_MAX_MS);
+        return (-1);
+    }
+    file = fopen(SETTLE_FILE, "w");
+    if (!file)
+    {
+        printf("Error: Could not create %s\n", SETTLE_FILE);
+        return (-1);
+    }
+    fprintf(file, "%d\n", milliseconds);
+    if (fclose(file) != 0)
+    {
+        printf("Error: Unable to write %s\n", SETTLE_FILE);
+        return (-1);
+    }
+    printf("Pen settle time of %d ms saved to %s\n", milliseconds, SETTLE_FILE);
+    return (0);
+}
+
+
+int SettleDwell (int milliseconds, const MotionRecord *penChange, MotionRecord *dwell)
+{
+    if (milliseconds <= 0)
+    {
+        return (0);
+    }
+    dwell->op = MOTION_DWELL;
+    dwell->x = penChange->x;
+    dwell->y = penChange->y;
+    dwell->i = (int16_t)milliseconds;
+    dwell->j = 0;
+    return (1);
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+#include "motion.h"
+#include "sink.h"
+
+
+#ifndef SETTLE_H_INCLUDED
+#define SETTLE_H_INCLUDED
+
+
+#define SETTLE_FILE             "PenSettle.txt" /* Where the calibrated settle time is kept, in milliseconds */
+#define SETTLE_DEFAULT_MS       100             /* Used until the pen is calibrated: the old fixed delay after every command */
+#define SETTLE_MAX_MS           2000            /* Longest settle time accepted; anything longer is a mistake */
+#define SETTLE_STEP_MS          25              /* Difference in dwell between neighbouring calibration marks */
+#define SETTLE_MARKS            13              /* Marks on the calibration card, 0 ms to 300 ms */
+#define SETTLE_MARK_PITCH_MM    8.0             /* Distance between the left ends of neighbouring marks */
+#define SETTLE_DASH_MM          5.0             /* Length of each mark */
+#define SETTLE_CARD_Y_MM        -5.0            /* Height the marks are drawn at, just inside the writing area */
+
+// The servo has no feedback, so its settle time is measured by eye: the card draws SETTLE_MARKS dashes,
+// each with a longer dwell after the pen goes down and after it comes up. Until the pen has settled, a dash
+// starts late or faint and the travel to the next one leaves a tail. The first clean mark is the settle time.
+void DrawSettleCalibration (const SinkList *sinks);
+
+int SettleForMark (int mark);                   // Dwell of a calibration mark, counting from 1 at the left; -1 if there is no such mark
+
+int LoadPenSettle (void);                       // Calibrated settle time, or SETTLE_DEFAULT_MS if there is none yet
+int SavePenSettle (int milliseconds);           // Returns -1 if the file cannot be written
+
+// The dwell that follows a pen change, at the pen's position. Returns 0 if the settle time is 0 and no dwell is needed.
+int SettleDwell (int milliseconds, const MotionRecord *penChange, MotionRecord *dwell);
+
+#endif // SETTLE_H_INCLUDED
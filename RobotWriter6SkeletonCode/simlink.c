@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "simlink.h"
+#include "numbered.h"
+#include "planner.h"
+
+
+static double NextRandom (SimulatedController *sim)
+{
+    // xorshift64: fast, and the same on every platform
+    sim->random ^= sim->random << 13;
+    sim->random ^= sim->random >> 7;
+    sim->random ^= sim->random << 17;
+    return (double)(sim->random >> 11) / 9007199254740992.0;
+}
+
+// Queues each line of text, to reach the host once the controller is done with the current line and the
+// reply line has carried everything before it
+static void Reply (SimulatedController *sim, const char *text)
+{
+    while (*text)
+    {
+        const char *newline = strchr(text, '\n');
+        int length = newline ? (int)(newline - text) : (int)strlen(text);
+        int kept = length < LINK_MAX_REPLY - 1 ? length : LINK_MAX_REPLY - 1;
+
+        if (sim->replyWireUs < sim->parsedUs)
+        {
+            sim->replyWireUs = sim->parsedUs;
+        }
+        sim->replyWireUs += (length + 1) * sim->byteUs;
+        sim->bytesOut += length + 1;
+        if (sim->replyCount < SIMLINK_MAX_REPLIES)
+        {
+            SimulatedReply *reply = &sim->replies[(sim->replyHead + sim->replyCount) % SIMLINK_MAX_REPLIES];
+
+            memcpy(reply->text, text, (size_t)kept);
+            reply->text[kept] = '\0';
+            reply->readyUs = sim->replyWireUs + sim->latencyUs;
+            sim->replyCount++;
+        }
+        text += newline ? length + 1 : length;
+    }
+}
+
+static void FinishBlock (SimulatedController *sim)
+{
+    sim->blockHead = (sim->blockHead + 1) % SIMLINK_PLANNER_BLOCKS;
+    sim->blockCount--;
+}
+
+// Works out how long the line keeps the controller and its planner busy, the way GRBL handles it
+static void PlanLine (SimulatedController *sim)
+{
+    const char *c = sim->line;
+    double x = sim->x, y = sim->y, i = 0.0, j = 0.0, dwell = 0.0;
+    int mode = sim->motionMode, moved = 0, dwelling = 0, sync = 0;
+
+    while (*c && *c != '*')
+    {
+        char *end;
+        double value = strtod(c + 1, &end);
+
+        if (end == c + 1)
+        {
+            c++;
+            continue;
+        }
+        switch (*c)
+        {
+            case 'G':
+                if (value == 0.0 || value == 1.0 || value == 2.0 || value == 3.0) mode = (int)value;
+                if (value == 4.0) dwelling = 1;
+                break;
+            case 'X': x = value; moved = 1; break;
+            case 'Y': y = value; moved = 1; break;
+            case 'I': i = value; break;
+            case 'J': j = value; break;
+            case 'F': sim->feed = value / 60.0; break;
+            case 'P': dwell = value; break;
+            case 'S':
+            case 'M': sync = 1; break;
+        }
+        c = end;
+    }
+
+    if (sync || dwelling)
+    {
+        // GRBL finishes every planned move before a spindle change or dwell, and parses nothing while it dwells
+        if (sim->parsedUs < sim->motionEndUs)
+        {
+            sim->parsedUs = sim->motionEndUs;
+        }
+        sim->parsedUs += dwelling ? dwell * 1e6 : 0.0;
+        sim->motionEndUs = sim->parsedUs;
+        sim->blockCount = 0;
+        sim->afterSync = 1;
+    }
+    sim->motionMode = mode;
+
+    if (moved)
+    {
+        double length, start, duration;
+
+        if (mode == 2 || mode == 3)
+        {
+            double cx = sim->x + i, cy = sim->y + j;
+            double sweep = atan2(sim->y - cy, sim->x - cx) - atan2(y - cy, x - cx);
+
+            sweep = mode == 2 ? sweep : -sweep;
+            if (sweep <= 0.0)
+            {
+                sweep += 2.0 * 3.14159265358979323846;
+            }
+            length = hypot(i, j) * sweep;
+        }
+        else
+        {
+            length = hypot(x - sim->x, y - sim->y);
+        }
+        duration = length / (mode == 0 ? PLANNER_MAX_RATE_X / 60.0 : sim->feed) * 1e6;
+
+        while (sim->blockCount > 0 && sim->blockEnds[sim->blockHead] <= sim->parsedUs)
+        {
+            FinishBlock(sim);
+        }
+        if (sim->blockCount == SIMLINK_PLANNER_BLOCKS)
+        {
+            sim->parsedUs = sim->blockEnds[sim->blockHead];     // Full: the line waits for the oldest move to finish
+            FinishBlock(sim);
+        }
+
+        start = sim->motionEndUs;
+        if (start < sim->parsedUs)
+        {
+            if (!sim->afterSync && sim->moves > 0)
+            {
+                sim->stalls++;
+                sim->stallUs += sim->parsedUs - start;
+            }
+            start = sim->parsedUs;
+        }
+        sim->afterSync = 0;
+        sim->moves++;
+        sim->motionUs += duration;
+        sim->motionEndUs = start + duration;
+        sim->blockEnds[(sim->blockHead + sim->blockCount) % SIMLINK_PLANNER_BLOCKS] = sim->motionEndUs;
+        sim->blockCount++;
+        sim->x = x;
+        sim->y = y;
+    }
+}
+
+// Every ok says which line was accepted last, like Marlin with ADVANCED_OK
+static void ReplyOk (SimulatedController *sim)
+{
+    char text[32];
+
+    if (sim->numbered)
+    {
+        sprintf(text, "ok N%ld\n", sim->expected - 1);
+        Reply(sim, text);
+    }
+    else
+    {
+        Reply(sim, "ok\n");
+    }
+}
+
+static void AskForResend (SimulatedController *sim, const char *why)
+{
+    char text[128];
+
+    sprintf(text, "Error:%s, Last Line: %ld\nResend: %ld\n", why, sim->expected - 1, sim->expected);
+    Reply(sim, text);
+    ReplyOk(sim);
+    sim->rejected++;
+}
+
+static void Accept (SimulatedController *sim)
+{
+    sim->accepted++;
+    sim->damagedAccepted += sim->lineDamaged;
+    if (sim->modelMotion)
+    {
+        PlanLine(sim);
+    }
+    ReplyOk(sim);
+}
+
+// Checks a line the way Marlin does: "N<number> <command>*<checksum>", numbers in sequence
+static void ProcessLine (SimulatedController *sim, double arrivedUs)
+{
+    const char *line = sim->line;
+    const char *star;
+    char *after, *end;
+    long number;
+
+    sim->parsedUs = (arrivedUs > sim->parsedUs ? arrivedUs : sim->parsedUs) + SIMLINK_TURNAROUND_US;
+    if (sim->lineLength == 0)
+    {
+        return;
+    }
+    if (line[0] != 'N')
+    {
+        if (sim->numbered)
+        {
+            AskForResend(sim, "No Line Number with checksum");
+        }
+        else
+        {
+            Accept(sim);
+        }
+        return;
+    }
+
+    // The checksum must end the line, or two lines run together by a damaged newline could pass as the first
+    star = memchr(line, '*', (size_t)sim->lineLength);
+    number = strtol(line + 1, &after, 10);
+    if (!star || after == line + 1 || *after != ' '
+        || strtol(star + 1, &end, 10) != NumberedChecksum(line, (size_t)(star - line)) || end == star + 1 || *end != '\0')
+    {
+        AskForResend(sim, "checksum mismatch");
+        return;
+    }
+    if (strncmp(after + 1, "M110", 4) == 0)
+    {
+        sim->numbered = 1;
+        sim->expected = number + 1;
+        Accept(sim);
+        return;
+    }
+    if (number < sim->expected)
+    {
+        sim->duplicates++;      // Sent again after a resend request that was already dealt with
+    }
+    if (number != sim->expected)
+    {
+        AskForResend(sim, "Line Number is not Last Line Number+1");
+        return;
+    }
+    sim->expected++;
+    Accept(sim);
+}
+
+// Takes out of the receive buffer every line the controller has parsed by the time a byte arrives
+static void FreeReceived (SimulatedController *sim, double arrivedUs)
+{
+    while (sim->rxCount > 0 && sim->rxLines[sim->rxHead].parsedUs <= arrivedUs)
+    {
+        sim->rxUsed -= sim->rxLines[sim->rxHead].bytes;
+        sim->rxHead = (sim->rxHead + 1) % SIMLINK_MAX_RX;
+        sim->rxCount--;
+    }
+}
+
+static int SendToSimulation (void *context, const char *bytes, size_t length)
+{
+    SimulatedController *sim = context;
+    size_t k;
+
+    for (k = 0; k < length; k++)
+    {
+        char byte = bytes[k];
+        double arrivedUs;
+
+        sim->clockUs += sim->byteUs;
+        sim->bytesIn++;
+        arrivedUs = sim->clockUs + sim->latencyUs;
+        if (sim->byteErrorRate > 0.0 && NextRandom(sim) < sim->byteErrorRate)
+        {
+            byte ^= (char)(1 << (int)(NextRandom(sim) * 8));
+            sim->flippedBytes++;
+            sim->lineDamaged = 1;
+        }
+        if (sim->rxBuffer > 0)
+        {
+            FreeReceived(sim, arrivedUs);
+            if (sim->rxUsed >= sim->rxBuffer)
+            {
+                sim->overflows++;       // Lost, and the line it belonged to is damaged
+                sim->lineDamaged = 1;
+                continue;
+            }
+            sim->rxUsed++;
+            sim->lineRxBytes++;
+        }
+
+        if (byte == '\n')
+        {
+            sim->line[sim->lineLength] = '\0';
+            ProcessLine(sim, arrivedUs);
+            if (sim->rxBuffer > 0)
+            {
+                SimulatedRxLine *received = &sim->rxLines[(sim->rxHead + sim->rxCount) % SIMLINK_MAX_RX];
+
+                received->bytes = sim->lineRxBytes;
+                received->parsedUs = sim->parsedUs;
+                sim->rxCount++;
+            }
+            sim->lineLength = 0;
+            sim->lineDamaged = 0;
+            sim->lineRxBytes = 0;
+        }
+        else if (sim->lineLength < SIMLINK_MAX_LINE - 1)
+        {
+            sim->line[sim->lineLength++] = byte;
+        }
+    }
+    return (0);
+}
+
+static int ReceiveFromSimulation (void *context, char *reply, int size, int timeoutMs)
+{
+    SimulatedController *sim = context;
+    const SimulatedReply *next = &sim->replies[sim->replyHead];
+
+    if (sim->replyCount == 0 || next->readyUs > sim->clockUs + timeoutMs * 1000.0)
+    {
+        sim->clockUs += timeoutMs * 1000.0;     // Nothing is coming in time
+        return (0);
+    }
+    if (sim->clockUs < next->readyUs)
+    {
+        sim->clockUs = next->readyUs;
+    }
+    snprintf(reply, (size_t)size, "%s", next->text);
+    sim->replyHead = (sim->replyHead + 1) % SIMLINK_MAX_REPLIES;
+    sim->replyCount--;
+    return (int)strlen(reply);
+}
+
+
+void StartSimulatedController (SimulatedController *sim, double baud, double bitErrorRate, unsigned int seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->byteUs = 10.0 * 1e6 / baud;     // Start bit, eight data bits, stop bit
+    sim->bitErrorRate = bitErrorRate;
+    sim->byteErrorRate = 1.0 - pow(1.0 - bitErrorRate, 8);
+    sim->random = 0x9E3779B97F4A7C15ull ^ seed;
+    sim->expected = 1;
+    sim->feed = PLANNER_DRAW_FEED / 60.0;
+}
+
+void SimulateGrbl (SimulatedController *sim, int rxBuffer, double latencyMs, int modelMotion)
+{
+    sim->rxBuffer = rxBuffer < SIMLINK_MAX_RX ? rxBuffer : SIMLINK_MAX_RX;
+    sim->latencyUs = latencyMs * 1000.0;
+    sim->modelMotion = modelMotion;
+}
+
+SerialLink SimulatedLink (SimulatedController *sim)
+{
+    SerialLink link = { "simulated", SendToSimulation, ReceiveFromSimulation, sim };
+    return link;
+}
+
+double SimulatedSeconds (const SimulatedController *sim)
+{
+    return sim->clockUs / 1e6;
+}
+
+double SimulatedJobSeconds (const SimulatedController *sim)
+{
+    return (sim->clockUs > sim->motionEndUs ? sim->clockUs : sim->motionEndUs) / 1e6;
+}
+
+void PrintSimulatedStats (const SimulatedController *sim)
+{
+    printf("Simulated controller: %.2f s, %lld bytes in, %lld out, %ld bytes damaged, %ld lines accepted (%ld of them damaged), "
+           "%ld rejected, %ld duplicates\n",
+           SimulatedSeconds(sim), sim->bytesIn, sim->bytesOut, sim->flippedBytes, sim->accepted, sim->damagedAccepted,
+           sim->rejected, sim->duplicates);
+    if (sim->rxBuffer > 0 || sim->modelMotion)
+    {
+        printf("  As GRBL: %ld bytes lost to a full receive buffer, %ld moves taking %.2f s, %ld stops mid-stroke for want of "
+               "the next move costing %.2f s, done at %.2f s\n",
+               sim->overflows, sim->moves, sim->motionUs / 1e6, sim->stalls, sim->stallUs / 1e6, SimulatedJobSeconds(sim));
+    }
+}
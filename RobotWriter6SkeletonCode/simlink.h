@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#include "link.h"
+#include "gcodefile.h"
+
+
+#ifndef SIMLINK_H_INCLUDED
+#define SIMLINK_H_INCLUDED
+
+
+#define SIMLINK_TURNAROUND_US   500.0           /* Controller time to parse a line and start its reply */
+#define SIMLINK_MAX_LINE        (2 * GCODE_MAX_LINE) /* Longest line it collects; a damaged newline can join two */
+#define SIMLINK_MAX_REPLIES     256             /* Replies waiting to be read */
+#define SIMLINK_MAX_RX          1024            /* Largest receive buffer SimulateGrbl can model */
+#define SIMLINK_PLANNER_BLOCKS  15              /* Moves GRBL's planner holds: 16 on an Uno, one always kept free */
+
+typedef struct
+{
+    char text[LINK_MAX_REPLY];
+    double readyUs;                             // When its last byte reaches the host
+} SimulatedReply;
+
+typedef struct
+{
+    int bytes;
+    double parsedUs;                            // When the controller takes it out of the buffer
+} SimulatedRxLine;
+
+typedef struct
+{
+    double byteUs;                              // Time for one byte on the wire: 10 bits at the baud rate
+    double bitErrorRate;                        // Chance of each data bit sent to the controller arriving flipped
+    double byteErrorRate;                       // The same per byte, worked out once
+    unsigned long long random;                  // xorshift state, so every run damages the same bits
+    char line[SIMLINK_MAX_LINE];                // Line being received
+    int lineLength;
+    int lineDamaged;                            // Set if any byte of it was flipped
+    int numbered;                               // Set once an M110 has switched on line number checking
+    long expected;                              // Line number it accepts next
+    SimulatedReply replies[SIMLINK_MAX_REPLIES];    // Replies not yet read, oldest at replyHead
+    int replyHead, replyCount;
+    double replyWireUs;                         // When the reply line to the host is next free
+    double clockUs;                             // Time on the link so far, as the host sees it
+    double parsedUs;                            // When the controller finished with the last line
+
+    // GRBL model, off unless SimulateGrbl is called
+    double latencyUs;                           // Added each way by the USB serial adapter
+    int rxBuffer;                               // Bytes it holds before it drops what arrives, 0 for no limit
+    int rxUsed;                                 // Bytes in it when the last byte arrived
+    SimulatedRxLine rxLines[SIMLINK_MAX_RX];    // Complete lines still in it, oldest at rxHead
+    int rxHead, rxCount;
+    int lineRxBytes;                            // Bytes of the line being received that found room
+    int modelMotion;                            // Set if moves take time and fill the planner
+    double blockEnds[SIMLINK_PLANNER_BLOCKS];   // When each planned move finishes, oldest at blockHead
+    int blockHead, blockCount;
+    double motionEndUs;                         // When the last planned move finishes
+    int afterSync;                              // The planner was emptied on purpose, for a pen change or dwell
+    double x, y;                                // mm, at the end of the last planned move
+    double feed;                                // mm/s, from the last F word
+    int motionMode;                             // G0 to G3
+    long long bytesIn, bytesOut;
+    long flippedBytes;
+    long accepted;                              // Lines it acted on
+    long rejected;                              // Lines it asked to have resent
+    long duplicates;                            // Lines it had already accepted, answered with a resend request like any out of order line
+    long damagedAccepted;                       // Lines it acted on although a bit was flipped: undetected errors
+    long overflows;                             // Bytes dropped because the receive buffer was full
+    long moves;                                 // Moves planned
+    long stalls;                                // Times the planner ran dry in the middle of a stroke, so the pen stopped
+    double stallUs, motionUs;                   // Time lost to those stops, and time spent moving
+} SimulatedController;                          // A controller stand-in for measuring senders, with a noisy receive line
+
+void StartSimulatedController (SimulatedController *sim, double baud, double bitErrorRate, unsigned int seed);
+
+// Makes it behave like GRBL behind a USB serial adapter: latencyMs each way, a receive buffer of rxBuffer bytes
+// that drops whatever arrives while it is full, and an ok for each line as it enters the planner. With
+// modelMotion the moves take their length over the feed rate (G0 at PLANNER_MAX_RATE_X, no acceleration),
+// the planner holds SIMLINK_PLANNER_BLOCKS of them, and pen changes and dwells wait for it to empty first.
+void SimulateGrbl (SimulatedController *sim, int rxBuffer, double latencyMs, int modelMotion);
+
+// The link a sender uses to talk to it. Time passes only as bytes are sent, replies are read and timeouts
+// run out, so a whole job is measured in far less time than it would take.
+SerialLink SimulatedLink (SimulatedController *sim);
+
+double SimulatedSeconds (const SimulatedController *sim);       // Time the host has spent on the link
+double SimulatedJobSeconds (const SimulatedController *sim);    // The same or, if later, until the last move finishes
+void PrintSimulatedStats (const SimulatedController *sim);
+
+#endif // SIMLINK_H_INCLUDED
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sink.h"
+#include "serial.h"
+
+
+void StartSinks (SinkList *sinks)
+{
+    sinks->count = 0;
+}
+
+int AttachSink (SinkList *sinks, CommandSink sink)
+{
+    if (sinks->count == SINK_MAX)
+    {
+        printf("Error: Unable to attach the %s sink, %d are attached already.\n", sink.name, SINK_MAX);
+        return (-1);
+    }
+    sinks->sinks[sinks->count++] = sink;
+    return (0);
+}
+
+void EmitCommand (const SinkList *sinks, const char *text, size_t length)
+{
+    int k;
+
+    for (k = 0; k < sinks->count; k++)
+    {
+        sinks->sinks[k].write(sinks->sinks[k].context, text, length);
+    }
+}
+
+void FinishSinks (SinkList *sinks)
+{
+    int k;
+
+    for (k = 0; k < sinks->count; k++)
+    {
+        if (sinks->sinks[k].finish)
+        {
+            sinks->sinks[k].finish(sinks->sinks[k].context);
+        }
+    }
+    sinks->count = 0;
+}
+
+
+static int serialLost = 0;          // Set once the robot stops answering; the rest of the job is not sent
+
+static void WriteSerial (void *context, const char *text, size_t length)
+{
+    (void)context;
+    (void)length;
+    if (serialLost)
+    {
+        return;
+    }
+    PrintBuffer((char *)text);      // PrintBuffer only reads the buffer, it just predates const
+    if (WaitForReply() < 0)         // Wait for the robot's response; pen changes are followed by a G4 dwell, so nothing else to wait for
+    {
+        printf("Error: The robot stopped answering, the rest of the job is not sent\n");
+        serialLost = 1;
+    }
+}
+
+CommandSink SerialSink (void)
+{
+    CommandSink sink = { "serial", WriteSerial, NULL, NULL };
+    return sink;
+}
+
+static void WriteNumbered (void *context, const char *text, size_t length)
+{
+    SendNumbered(context, text, length);    // Once a line fails the rest are dropped, and the stats say so
+}
+
+static void FinishNumbered (void *context)
+{
+    PrintNumberedStats(context);
+}
+
+CommandSink NumberedSink (NumberedSender *sender)
+{
+    CommandSink sink = { "numbered serial", WriteNumbered, FinishNumbered, sender };
+    return sink;
+}
+
+static void WriteStreamed (void *context, const char *text, size_t length)
+{
+    SendStreamed(context, text, length);    // Once the robot stops answering the rest are dropped, and the stats say so
+}
+
+static void FinishStreamed (void *context)
+{
+    FinishStreaming(context);
+    PrintStreamStats(context);
+}
+
+CommandSink StreamSink (StreamSender *sender)
+{
+    CommandSink sink = { "streaming serial", WriteStreamed, FinishStreamed, sender };
+    return sink;
+}
+
+
+static void WriteTerminal (void *context, const char *text, size_t length)
+{
+    (void)context;
+    fwrite(text, 1, length, stdout);
+}
+
+CommandSink TerminalSink (void)
+{
+    CommandSink sink = { "terminal", WriteTerminal, NULL, NULL };
+    return sink;
+}
+
+
+// The writer only copies into its 4 MB buffer, so mirroring to a file adds no wait to the robot stream
+static void WriteFileSink (void *context, const char *text, size_t length)
+{
+    WriteGCode(context, text, length);
+}
+
+CommandSink FileSink (GCodeWriter *writer)
+{
+    CommandSink sink = { "file", WriteFileSink, NULL, writer };
+    return sink;
+}
+
+static void WriteJob (void *context, const char *text, size_t length)
+{
+    WriteJobCommand(context, text, length);
+}
+
+CommandSink JobSink (JobWriter *writer)
+{
+    CommandSink sink = { "job file", WriteJob, NULL, writer };
+    return sink;
+}
+
+
+static void PlotPoint (Preview *preview, double x, double y)
+{
+    int column = (int)floor(x / PREVIEW_MM_PER_COLUMN);
+    int row = (int)floor((PREVIEW_TOP_MM - y) / PREVIEW_MM_PER_ROW);      // The page runs downwards
+
+    if (column < 0 || column >= PREVIEW_COLUMNS || row < 0 || row >= PREVIEW_ROWS)
+    {
+        preview->clipped++;
+        return;
+    }
+    preview->canvas[row][column] = '#';
+    if (row > preview->lowestRow)
+    {
+        preview->lowestRow = row;
+    }
+}
+
+// Arcs are drawn as their chords, which is close enough at this resolution
+static void PlotSegment (Preview *preview, double x0, double y0, double x1, double y1)
+{
+    double dx = (x1 - x0) / PREVIEW_MM_PER_COLUMN;
+    double dy = (y1 - y0) / PREVIEW_MM_PER_ROW;
+    int steps = (int)ceil(2.0 * fmax(fabs(dx), fabs(dy)));     // Half a cell at a time, so no cell is skipped
+    int k;
+
+    for (k = 0; k <= steps; k++)
+    {
+        double t = steps ? (double)k / steps : 0.0;
+
+        PlotPoint(preview, x0 + (x1 - x0) * t, y0 + (y1 - y0) * t);
+    }
+}
+
+// Reads the command back the way the robot would: G and the coordinates are modal, S above zero is pen down
+static void WritePreview (void *context, const char *text, size_t length)
+{
+    Preview *preview = context;
+    double x = preview->x, y = preview->y;
+    int moved = 0;
+    const char *p = text;
+    const char *end = text + length;
+
+    while (p < end)
+    {
+        char letter = *p++;
+        char *after;
+        double value;
+
+        if (letter < 'A' || letter > 'Z')
+        {
+            continue;
+        }
+        value = strtod(p, &after);
+        if (after == p)
+        {
+            continue;
+        }
+        p = after;
+
+        switch (letter)
+        {
+            case 'G': if (value <= 3) preview->motionMode = (int)value; break;
+            case 'X': x = value; moved = 1; break;
+            case 'Y': y = value; moved = 1; break;
+            case 'S': preview->penDown = value > 0; break;
+            default: break;
+        }
+    }
+
+    if (moved)
+    {
+        if (preview->penDown && preview->motionMode != 0)
+        {
+            PlotSegment(preview, preview->x, preview->y, x, y);
+        }
+        preview->x = x;
+        preview->y = y;
+    }
+}
+
+static void FinishPreview (void *context)
+{
+    Preview *preview = context;
+    int row, last;
+
+    printf("Preview, %.1f mm per column and %.1f mm per row:\n", PREVIEW_MM_PER_COLUMN, PREVIEW_MM_PER_ROW);
+    for (row = 0; row <= preview->lowestRow; row++)
+    {
+        for (last = PREVIEW_COLUMNS; last > 0 && preview->canvas[row][last - 1] == ' '; last--)
+        {
+        }
+        printf("|%.*s\n", last, preview->canvas[row]);
+    }
+    if (preview->clipped > 0)
+    {
+        printf("Preview: %ld drawn points were off the edge of the preview\n", preview->clipped);
+    }
+}
+
+CommandSink PreviewSink (Preview *preview)
+{
+    CommandSink sink = { "preview", WritePreview, FinishPreview, preview };
+
+    memset(preview->canvas, ' ', sizeof(preview->canvas));
+    preview->x = 0.0;
+    preview->y = 0.0;
+    preview->penDown = 0;
+    preview->motionMode = 0;
+    preview->lowestRow = -1;
+    preview->clipped = 0;
+    return sink;
+}
+
+
+static void WriteStats (void *context, const char *text, size_t length)
+{
+    SinkStats *stats = context;
+
+    stats->commands++;
+    stats->bytes += (long long)length;
+    if ((int)length > stats->longest)
+    {
+        stats->longest = (int)length;
+    }
+
+    switch (text[0])
+    {
+        case 'G':
+            if (text[1] == '4' && (text[2] < '0' || text[2] > '9')) stats->dwells++;
+            else if (text[1] == '0' && (text[2] < '0' || text[2] > '9')) stats->travels++;
+            else stats->draws++;
+            break;
+        case 'S':
+        case 'M': stats->penCommands++; break;
+        case 'X':
+        case 'Y': stats->modalLines++; break;
+        default: break;
+    }
+}
+
+static void FinishStats (void *context)
+{
+    SinkStats *stats = context;
+
+    printf("Sent %ld commands, %lld bytes (%.1f per command, longest %d): %ld travels, %ld draws, %ld pen commands, %ld dwells, %ld modal moves\n",
+           stats->commands, stats->bytes, stats->commands ? (double)stats->bytes / stats->commands : 0.0, stats->longest,
+           stats->travels, stats->draws, stats->penCommands, stats->dwells, stats->modalLines);
+}
+
+CommandSink StatsSink (SinkStats *stats)
+{
+    CommandSink sink = { "stats", WriteStats, FinishStats, stats };
+
+    memset(stats, 0, sizeof(*stats));
+    return sink;
+}
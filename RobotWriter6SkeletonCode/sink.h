@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include "gcodefile.h"
+#include "jobfile.h"
+#include "numbered.h"
+#include "stream.h"
+
+
+#ifndef SINK_H_INCLUDED
+#define SINK_H_INCLUDED
+
+
+#define SINK_MAX                8               /* Most sinks one job can feed at once */
+#define PREVIEW_COLUMNS         110             /* Width of the text preview in characters */
+#define PREVIEW_ROWS            150             /* Most rows the text preview can have */
+#define PREVIEW_MM_PER_COLUMN   1.0             /* Paper covered by one character cell; cells are about twice as tall as wide */
+#define PREVIEW_MM_PER_ROW      2.0
+#define PREVIEW_TOP_MM          10.0            /* Y at the top of the preview; the first line of text sits above Y = 0 */
+
+typedef struct
+{
+    const char *name;                           // Shown in error messages
+    void (*write) (void *context, const char *text, size_t length);   // Gets each command once, newline and NUL terminated
+    void (*finish) (void *context);             // Called once at the end of the job, may be NULL
+    void *context;                              // Passed back to write and finish
+} CommandSink;                                  // Somewhere the encoded commands go
+
+typedef struct
+{
+    CommandSink sinks[SINK_MAX];
+    int count;
+} SinkList;                                     // Every sink a job is feeding, in the order they get each command
+
+typedef struct
+{
+    char canvas[PREVIEW_ROWS][PREVIEW_COLUMNS];
+    double x, y;                                // Where the pen is, mm, as read back from the commands
+    int penDown;
+    int motionMode;                             // Last G0 to G3 read, as it carries over to lines without one
+    int lowestRow;                              // Last row anything was drawn on, -1 while the canvas is blank
+    long clipped;                               // Drawn points that fell outside the canvas
+} Preview;                                      // Draws the job as text, from the commands themselves
+
+typedef struct
+{
+    long commands;
+    long long bytes;
+    long travels;                               // G0
+    long draws;                                 // G1, G2 and G3
+    long penCommands;                           // S and M
+    long dwells;                                // G4
+    long modalLines;                            // Lines with coordinates but no G word of their own
+    int longest;                                // Longest command in bytes, newline included
+} SinkStats;                                    // Counts what went out
+
+void StartSinks (SinkList *sinks);
+int AttachSink (SinkList *sinks, CommandSink sink);                           // Returns -1 if SINK_MAX are attached already
+
+// Hands the command to every attached sink in turn. text must stay NUL terminated at text[length];
+// nothing is copied or reformatted, so each extra sink costs only its own work.
+void EmitCommand (const SinkList *sinks, const char *text, size_t length);
+
+void FinishSinks (SinkList *sinks);             // Lets every sink print its report
+
+CommandSink SerialSink (void);                  // Sends each command to the robot and waits for its reply
+CommandSink NumberedSink (NumberedSender *sender);      // The same with line numbers, checksums and resends; started by the caller
+CommandSink StreamSink (StreamSender *sender);  // Streams to fill the robot's receive buffer, and waits for the last replies at the end
+CommandSink TerminalSink (void);                // Prints each command, for debugging
+CommandSink FileSink (GCodeWriter *writer);     // Appends to a file opened by the caller, who also closes it
+CommandSink JobSink (JobWriter *writer);        // The same for a job file
+CommandSink PreviewSink (Preview *preview);
+CommandSink StatsSink (SinkStats *stats);
+
+#endif // SINK_H_INCLUDED
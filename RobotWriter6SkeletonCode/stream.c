@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+
+
+// Waits for the next ok or error and frees the room its line took. Status reports, messages and the start-up
+// banner answer no line, so they are passed over.
+static int AwaitAnswer (StreamSender *sender)
+{
+    char reply[LINK_MAX_REPLY];
+
+    for (;;)
+    {
+        int length = sender->link.receive(sender->link.context, reply, sizeof(reply), STREAM_TIMEOUT_MS);
+
+        if (length == LINK_REPLY_TOO_LONG)
+        {
+            printf("Error: The %s link got a reply too long to read with %d bytes outstanding\n", sender->link.name, sender->outstanding);
+            return (-1);
+        }
+        if (length < 0)
+        {
+            printf("Error: The %s link failed with %d bytes outstanding\n", sender->link.name, sender->outstanding);
+            return (-1);
+        }
+        if (length == 0)
+        {
+            printf("Error: No reply from the robot in %d ms with %d lines (%d bytes) outstanding\n",
+                   STREAM_TIMEOUT_MS, sender->pendingCount, sender->outstanding);
+            return (-1);
+        }
+        if (strncmp(reply, "ALARM", 5) == 0)
+        {
+            printf("Error: The robot raised %s and will not run anything more\n", reply);
+            return (-1);
+        }
+        if (strncmp(reply, "ok", 2) == 0 || strncmp(reply, "error", 5) == 0)
+        {
+            break;
+        }
+    }
+
+    if (sender->pendingCount == 0)
+    {
+        return (0);     // An answer to nothing we sent, such as the reply to a wake-up newline
+    }
+    if (reply[0] == 'e')
+    {
+        printf("Error: The robot rejected line %ld: %s\n", sender->answered + 1, reply);
+        sender->errors++;
+    }
+    sender->outstanding -= sender->pending[sender->pendingHead];
+    sender->pendingHead = (sender->pendingHead + 1) % STREAM_MAX_PENDING;
+    sender->pendingCount--;
+    sender->answered++;
+    return (0);
+}
+
+void StartStreaming (StreamSender *sender, SerialLink link, int rxBuffer)
+{
+    memset(sender, 0, sizeof(*sender));
+    sender->link = link;
+    sender->rxBuffer = rxBuffer;
+}
+
+int SendStreamed (StreamSender *sender, const char *text, size_t length)
+{
+    if (sender->failed)
+    {
+        return (-1);
+    }
+    if ((int)length > sender->rxBuffer)
+    {
+        printf("Error: A line of %d bytes does not fit in the robot's %d byte receive buffer\n", (int)length, sender->rxBuffer);
+        sender->failed = 1;
+        return (-1);
+    }
+
+    // Only as much as the controller has room for, or bytes would be lost off the end of its buffer
+    if (sender->outstanding + (int)length > sender->rxBuffer || sender->pendingCount == STREAM_MAX_PENDING)
+    {
+        sender->waits++;
+    }
+    while (sender->outstanding + (int)length > sender->rxBuffer || sender->pendingCount == STREAM_MAX_PENDING)
+    {
+        if (AwaitAnswer(sender) != 0)
+        {
+            sender->failed = 1;
+            return (-1);
+        }
+    }
+
+    if (sender->link.send(sender->link.context, text, length) != 0)
+    {
+        printf("Error: Could not send to the %s link\n", sender->link.name);
+        sender->failed = 1;
+        return (-1);
+    }
+    sender->pending[(sender->pendingHead + sender->pendingCount) % STREAM_MAX_PENDING] = (int)length;
+    sender->pendingCount++;
+    sender->outstanding += (int)length;
+    sender->lines++;
+    sender->bytes += (long long)length;
+    sender->fillSum += sender->outstanding;
+    if (sender->outstanding > sender->peak)
+    {
+        sender->peak = sender->outstanding;
+    }
+    return (0);
+}
+
+int FinishStreaming (StreamSender *sender)
+{
+    while (!sender->failed && sender->pendingCount > 0)
+    {
+        if (AwaitAnswer(sender) != 0)
+        {
+            sender->failed = 1;
+        }
+    }
+    return sender->failed ? -1 : 0;
+}
+
+void PrintStreamStats (const StreamSender *sender)
+{
+    printf("Streaming: %ld lines, %lld bytes, %ld errors, receive buffer %.0f%% full on average (peak %d of %d bytes), "
+           "%ld waits for room%s\n",
+           sender->lines, sender->bytes, sender->errors,
+           sender->lines > 0 ? 100.0 * (double)sender->fillSum / (double)sender->lines / sender->rxBuffer : 0.0,
+           sender->peak, sender->rxBuffer, sender->waits,
+           sender->failed ? ", stopped when the robot stopped answering" : "");
+}
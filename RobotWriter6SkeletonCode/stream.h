@@ -0,0 +1,43 @@
+#include <stdio.h>
+
+#include "link.h"
+
+
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+
+
+#define STREAM_RX_BUFFER        128             /* Bytes in GRBL's serial receive buffer on an Uno; larger boards have more */
+#define STREAM_MAX_PENDING      1024            /* Lines that can be waiting for their reply at once */
+#define STREAM_TIMEOUT_MS       30000           /* Longest wait for one reply; a full planner holds the oldest line back for a whole move */
+
+typedef struct
+{
+    SerialLink link;
+    int rxBuffer;                               // Bytes the controller can hold; never more than this is outstanding
+    int pending[STREAM_MAX_PENDING];            // Length of each line sent but not yet answered, oldest at pendingHead
+    int pendingHead, pendingCount;
+    int outstanding;                            // Their total: what sits in the controller's receive buffer
+    long answered;                              // Lines answered so far, so an error can say which line it was about
+    int failed;                                 // Set once the controller stops answering; later lines are dropped
+    long lines;                                 // Lines sent
+    long errors;                                // "error:" replies
+    long long bytes;
+    long waits;                                 // Times a line had to wait for room in the buffer
+    long long fillSum;                          // Outstanding bytes just after each line went, for the average
+    int peak;                                   // Most bytes outstanding at once
+} StreamSender;                                 // GRBL character-counting streaming: keep the receive buffer full instead of waiting for every ok
+
+// Starts streaming to a controller whose receive buffer holds rxBuffer bytes, STREAM_RX_BUFFER on a stock GRBL.
+void StartStreaming (StreamSender *sender, SerialLink link, int rxBuffer);
+
+// Sends one newline-terminated line as soon as it fits in the controller's receive buffer, collecting replies
+// only while it does not. Each ok or error answers the oldest line still outstanding; errors are reported and
+// the job goes on, as GRBL itself does. Returns -1 once the controller stops answering.
+int SendStreamed (StreamSender *sender, const char *text, size_t length);
+
+int FinishStreaming (StreamSender *sender);     // Waits for every outstanding line to be answered; -1 if they are not
+
+void PrintStreamStats (const StreamSender *sender);
+
+#endif // STREAM_H_INCLUDED
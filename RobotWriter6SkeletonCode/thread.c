@@ -0,0 +1,170 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L                 /* clock_gettime and CLOCK_MONOTONIC, even under a strict -std */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "thread.h"
+
+
+// A monotonic clock, so deadlines and timeouts neither expire early nor stretch when the system clock is set
+double WallClockMs (void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+#endif
+}
+
+
+typedef struct
+{
+    ThreadFunction function;
+    void *argument;
+} ThreadStart;                                  // Carries the caller's function across the platform entry point
+
+
+#ifdef _WIN32   // Windows threads
+
+static DWORD WINAPI ThreadEntry (LPVOID parameter)
+{
+    ThreadStart start = *(ThreadStart *)parameter;
+
+    free(parameter);
+    start.function(start.argument);
+    return (0);
+}
+
+int StartThread (ThreadHandle *thread, ThreadFunction function, void *argument)
+{
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+
+    if (!start)
+    {
+        return (-1);
+    }
+    start->function = function;
+    start->argument = argument;
+
+    *thread = CreateThread(NULL, 0, ThreadEntry, start, 0, NULL);
+    if (*thread == NULL)
+    {
+        free(start);
+        return (-1);
+    }
+    return (0);
+}
+
+void JoinThread (ThreadHandle thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+int CountProcessors (void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void InitMutex (ThreadMutex *mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void LockMutex (ThreadMutex *mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void UnlockMutex (ThreadMutex *mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+void DestroyMutex (ThreadMutex *mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+#else   // POSIX threads
+
+#include <unistd.h>
+
+static void *ThreadEntry (void *parameter)
+{
+    ThreadStart start = *(ThreadStart *)parameter;
+
+    free(parameter);
+    start.function(start.argument);
+    return NULL;
+}
+
+int StartThread (ThreadHandle *thread, ThreadFunction function, void *argument)
+{
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+
+    if (!start)
+    {
+        return (-1);
+    }
+    start->function = function;
+    start->argument = argument;
+
+    if (pthread_create(thread, NULL, ThreadEntry, start) != 0)
+    {
+        free(start);
+        return (-1);
+    }
+    return (0);
+}
+
+void JoinThread (ThreadHandle thread)
+{
+    pthread_join(thread, NULL);
+}
+
+int CountProcessors (void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+}
+
+void InitMutex (ThreadMutex *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void LockMutex (ThreadMutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void UnlockMutex (ThreadMutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+void DestroyMutex (ThreadMutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+#endif
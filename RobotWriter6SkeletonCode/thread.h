@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+
+#ifndef THREAD_H_INCLUDED
+#define THREAD_H_INCLUDED
+
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE ThreadHandle;
+typedef CRITICAL_SECTION ThreadMutex;
+#else
+#include <pthread.h>
+typedef pthread_t ThreadHandle;
+typedef pthread_mutex_t ThreadMutex;
+#endif
+
+typedef void (*ThreadFunction)(void *argument);
+
+int StartThread (ThreadHandle *thread, ThreadFunction function, void *argument);   // Returns -1 if the thread could not start
+void JoinThread (ThreadHandle thread);
+int CountProcessors (void);
+double WallClockMs (void);                      // Monotonic milliseconds from an arbitrary start, unaffected by other threads or clock changes
+
+void InitMutex (ThreadMutex *mutex);
+void LockMutex (ThreadMutex *mutex);
+void UnlockMutex (ThreadMutex *mutex);
+void DestroyMutex (ThreadMutex *mutex);
+
+#endif // THREAD_H_INCLUDED